@@ -0,0 +1,57 @@
+#include "arena.h"
+#include <algorithm>
+
+static thread_local Arena* currentArena = nullptr;
+static std::atomic<uint64_t> heapFallbacks{ 0 };
+
+Arena::Arena(size_t initialSize) : minimumBlockSize(initialSize) {
+	addBlock(initialSize);
+}
+
+void Arena::addBlock(size_t size) {
+	blocks.push_back(Block{ std::make_unique_for_overwrite<uint8_t[]>(size), size });
+	offset = 0;
+	blockAllocationCount++;
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+	if (size == 0) { size = 1; }
+	Block& block = blocks.back();
+	uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+	size_t aligned = ((base + offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+	if (aligned + size <= block.size) {
+		offset = aligned + size;
+		return block.memory.get() + aligned;
+	}
+	// Grow geometrically so an image much larger than the last one only costs a few blocks
+	size_t blockSize = std::max(std::max(minimumBlockSize, block.size * 2), size + alignment);
+	addBlock(blockSize);
+	Block& fresh = blocks.back();
+	base = reinterpret_cast<uintptr_t>(fresh.memory.get());
+	aligned = ((base + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+	offset = aligned + size;
+	return fresh.memory.get() + aligned;
+}
+
+void Arena::reset() {
+	if (blocks.size() > 1) {
+		size_t total = capacity();
+		blocks.clear();
+		addBlock(total);
+	}
+	offset = 0;
+}
+
+size_t Arena::capacity() const {
+	size_t total = 0;
+	for (const Block& block : blocks) { total += block.size; }
+	return total;
+}
+
+Arena* Arena::current() { return currentArena; }
+
+ArenaScope::ArenaScope(Arena& arena) : previous(currentArena) { currentArena = &arena; }
+ArenaScope::~ArenaScope() { currentArena = previous; }
+
+uint64_t scratchHeapAllocations() { return heapFallbacks.load(std::memory_order_relaxed); }
+void countScratchHeapAllocation() { heapFallbacks.fetch_add(1, std::memory_order_relaxed); }
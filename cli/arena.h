@@ -0,0 +1,89 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Bump allocator for the scratch memory of one image. Allocations are carved out of large blocks and never freed
+// individually; reset() releases everything at once. A reset after an image that needed several blocks swaps
+// them for one block of their combined size, so once the arena has seen the largest image in a batch it stops
+// touching the heap altogether.
+class Arena {
+private:
+	struct Block {
+		std::unique_ptr<uint8_t[]> memory;
+		size_t size;
+	};
+	std::vector<Block> blocks;
+	size_t offset = 0;	// into blocks.back()
+	size_t blockAllocationCount = 0;
+	size_t minimumBlockSize;
+
+	void addBlock(size_t size);
+public:
+	explicit Arena(size_t initialSize = size_t(1) << 20);
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t size, size_t alignment);
+	void reset();
+
+	// Blocks taken from the heap over the arena's lifetime
+	size_t blockAllocations() const { return blockAllocationCount; }
+	// Bytes held in blocks
+	size_t capacity() const;
+
+	// The arena ScratchVectors on this thread allocate from, or nullptr
+	static Arena* current();
+};
+
+// Makes 'arena' the current one on this thread until the scope ends
+class ArenaScope {
+private:
+	Arena* previous;
+public:
+	explicit ArenaScope(Arena& arena);
+	~ArenaScope();
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+// Heap allocations made by ScratchVectors created while no arena was current
+uint64_t scratchHeapAllocations();
+void countScratchHeapAllocation();
+
+// Allocator binding to the thread's current arena when it is constructed, or to the heap if there is none.
+// Deallocation from an arena does nothing; the memory comes back when the arena is reset.
+template<typename T>
+class ArenaAllocator {
+public:
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	Arena* arena;
+
+	ArenaAllocator() : arena(Arena::current()) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t count) {
+		if (arena != nullptr) { return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T))); }
+		countScratchHeapAllocation();
+		return static_cast<T*>(::operator new(count * sizeof(T)));
+	}
+	void deallocate(T* pointer, size_t) {
+		if (arena == nullptr) { ::operator delete(pointer); }
+	}
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+// Vector for per-image working memory. Must not outlive a reset of the arena that was current when it was made.
+template<typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,221 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <span>
+#include <bit>
+#include <bitset>
+
+#ifdef _MSC_VER
+#include <stdlib.h>
+#define BITVECTOR_BSWAP64(x) _byteswap_uint64(x)
+#else
+#define BITVECTOR_BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+// Packed, append-only bit buffer. Bits are stored MSB-first in 64-bit words, and every completed word is
+// kept in big-endian byte order so that the storage can be handed out as a byte stream without repacking.
+// The word currently being filled lives in 'acc' (native order) until it is full, or until dump() is called.
+class bitvector {
+private:
+	std::vector<uint64_t> words;
+	uint64_t acc = 0;
+	size_t bitCount = 0;
+	bool accSynced = false;
+
+	static uint64_t toStorage(uint64_t word) {
+		if constexpr (std::endian::native == std::endian::little) { return BITVECTOR_BSWAP64(word); }
+		else { return word; }
+	}
+	static uint64_t fromStorage(uint64_t word) { return toStorage(word); }
+	void flushAcc() {
+		if (accSynced) { words.back() = toStorage(acc); }
+		else { words.push_back(toStorage(acc)); }
+		acc = 0;
+		accSynced = false;
+	}
+	// Writes the partially filled word into storage so that the byte view is complete
+	void syncAcc() {
+		if ((bitCount & 63) == 0) { return; }
+		if (accSynced) { words.back() = toStorage(acc); }
+		else { words.push_back(toStorage(acc)); }
+		accSynced = true;
+	}
+	uint64_t wordAt(size_t wordIndex) const {
+		if (wordIndex < (bitCount >> 6)) { return fromStorage(words[wordIndex]); }
+		if (wordIndex == (bitCount >> 6)) { return acc; }
+		return 0;
+	}
+public:
+	bitvector() {}
+	// Creates an empty bitvector with room for 'bits' bits
+	explicit bitvector(size_t bits) { reserve(bits); }
+
+	void reserve(size_t bits) { words.reserve((bits + 63) >> 6); }
+	void clear() {
+		words.clear();
+		acc = 0;
+		bitCount = 0;
+		accSynced = false;
+	}
+	void swap(bitvector& other) {
+		words.swap(other.words);
+		std::swap(acc, other.acc);
+		std::swap(bitCount, other.bitCount);
+		std::swap(accSynced, other.accSynced);
+	}
+	size_t size() const { return bitCount; }
+	bool empty() const { return bitCount == 0; }
+
+	void push_back(bool bit) {
+		acc |= static_cast<uint64_t>(bit) << (63 - (bitCount & 63));
+		bitCount++;
+		if ((bitCount & 63) == 0) { flushAcc(); }
+	}
+	// Appends the low 'count' bits of 'src', most significant first
+	void push_many_back(uint64_t src, uint32_t count) {
+		if (count == 0) { return; }
+		if (count > 64) { count = 64; }
+		if (count < 64) { src &= (uint64_t(1) << count) - 1; }
+		uint32_t used = bitCount & 63;
+		uint32_t free = 64 - used;
+		bitCount += count;
+		if (count < free) {
+			acc |= src << (free - count);
+		}
+		else if (count == free) {
+			acc |= src;
+			flushAcc();
+		}
+		else {
+			uint32_t spill = count - free;
+			acc |= src >> spill;
+			flushAcc();
+			acc = src << (64 - spill);
+		}
+	}
+	template<size_t size>
+	void push_many_back(std::bitset<size> bs) {
+		static_assert(size <= 64, "bitvector::push_many_back only accepts bitsets of up to 64 bits");
+		push_many_back(bs.to_ullong(), size);
+	}
+	void push_many_back(const bitvector& bv) {
+		size_t pos = 0;
+		for (; pos + 64 <= bv.size(); pos += 64) { push_many_back(bv.get_many(pos, 64), 64); }
+		push_many_back(bv.get_many(pos, bv.size() - pos), bv.size() - pos);
+	}
+	// Appends whole bytes. When the buffer is byte aligned this is a straight memcpy into the storage.
+	void push_bytes(const uint8_t* src, size_t count) {
+		if (count == 0) { return; }
+		if ((bitCount & 7) != 0) {
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8) {
+				uint64_t word;
+				memcpy(&word, src + i, 8);
+				push_many_back(fromStorage(word), 64);
+			}
+			for (; i < count; i++) { push_many_back(src[i], 8); }
+			return;
+		}
+		syncAcc();
+		size_t byteOffset = bitCount >> 3;
+		bitCount += count * 8;
+		words.resize((bitCount + 63) >> 6);
+		memcpy(reinterpret_cast<uint8_t*>(words.data()) + byteOffset, src, count);
+		acc = 0;
+		accSynced = false;
+		if ((bitCount & 63) != 0) {
+			acc = fromStorage(words.back());
+			words.pop_back();
+		}
+	}
+
+	bool at(size_t pos) const {
+		return (wordAt(pos >> 6) >> (63 - (pos & 63))) & 0x1;
+	}
+	bool operator[](size_t pos) const { return at(pos); }
+	// Reads 'count' (<= 64) bits starting at 'pos', returned right-aligned
+	uint64_t get_many(size_t pos, uint32_t count) const {
+		if (count == 0) { return 0; }
+		size_t wordIndex = pos >> 6;
+		uint32_t offset = pos & 63;
+		uint64_t hi = wordAt(wordIndex) << offset;
+		if (offset + count > 64) { hi |= wordAt(wordIndex + 1) >> (64 - offset); }
+		return hi >> (64 - count);
+	}
+
+	// Returns the packed contents as bytes, padded with zero bits up to the next byte boundary.
+	// The span aliases the internal storage and is invalidated by the next modification.
+	std::span<const uint8_t> dump() {
+		syncAcc();
+		return std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(words.data()), byte_size());
+	}
+	uint8_t* dump(uint8_t* out, size_t size) {
+		std::span<const uint8_t> bytes = dump();
+		size_t dumpSize = size < bytes.size() ? size : bytes.size();
+		if (dumpSize == 0) { return nullptr; }
+		memcpy(out, bytes.data(), dumpSize);
+		return out;
+	}
+	size_t byte_size() const {
+		return (bitCount + 7) >> 3;
+	}
+	// Hands every completed 64-bit word to 'sink' as a span of bytes and drops it, keeping only the word being
+	// filled, so a long stream can be written out as it is produced. size() then counts from the dropped words.
+	template<typename Sink>
+	void drain_words(Sink&& sink) {
+		if (accSynced) {
+			words.pop_back();
+			accSynced = false;
+		}
+		if (words.empty()) { return; }
+		sink(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(words.data()), words.size() * sizeof(uint64_t)));
+		words.clear();
+		bitCount &= 63;
+	}
+};
+
+// Reads bits MSB-first from a byte buffer, the counterpart of bitvector::dump()
+class bitreader {
+private:
+	const uint8_t* data;
+	size_t sizeBytes;
+	size_t bitPos = 0;
+
+	uint64_t loadWord(size_t byteIndex) const {
+		uint64_t word = 0;
+		if (byteIndex + 8 <= sizeBytes) {
+			memcpy(&word, data + byteIndex, 8);
+			if constexpr (std::endian::native == std::endian::little) { word = BITVECTOR_BSWAP64(word); }
+			return word;
+		}
+		for (size_t i = 0; i < 8; i++) {
+			word <<= 8;
+			if (byteIndex + i < sizeBytes) { word |= data[byteIndex + i]; }
+		}
+		return word;
+	}
+public:
+	bitreader(const uint8_t* data, size_t sizeBytes) : data(data), sizeBytes(sizeBytes) {}
+
+	size_t position() const { return bitPos; }
+	size_t remaining() const { return sizeBytes * 8 - bitPos; }
+	void seek(size_t pos) { bitPos = pos; }
+	void skip(size_t count) { bitPos += count; }
+	// Returns the next 'count' (<= 32) bits without consuming them. Bits past the end read as zero.
+	uint32_t peek(uint32_t count) const {
+		if (count == 0) { return 0; }
+		uint64_t word = loadWord(bitPos >> 3) << (bitPos & 7);
+		return static_cast<uint32_t>(word >> (64 - count));
+	}
+	// Consumes and returns the next 'count' (<= 64) bits, right-aligned
+	uint64_t read(uint32_t count) {
+		if (count > 32) {
+			uint64_t hi = read(count - 32);
+			return hi << 32 | read(32);
+		}
+		uint32_t value = peek(count);
+		bitPos += count;
+		return value;
+	}
+};
@@ -0,0 +1,407 @@
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <bit>
+#include "bmp.h"
+#include "mappedfile.h"
+
+constexpr uint32_t BI_RGB = 0;
+constexpr uint32_t BI_BITFIELDS = 3;
+constexpr uint32_t BI_ALPHABITFIELDS = 6;
+
+static uint16_t readU16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+static uint32_t readU32(const uint8_t* p) { return static_cast<uint32_t>(p[0] | p[1] << 8 | p[2] << 16) | static_cast<uint32_t>(p[3]) << 24; }
+static void writeU16(uint8_t* p, uint16_t v) { p[0] = v & 0xff; p[1] = v >> 8; }
+static void writeU32(uint8_t* p, uint32_t v) { p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; p[2] = (v >> 16) & 0xff; p[3] = v >> 24; }
+
+bool parseBMPHeader(const uint8_t* data, size_t size, BMPInfo& info) { return parseBMPHeader(data, size, size, info); }
+
+bool parseBMPHeader(const uint8_t* data, size_t size, uint64_t fileSize, BMPInfo& info) {
+	if (size < 14 + 12 || data[0] != 'B' || data[1] != 'M') {
+		std::cerr << "[Error] File is not a bitmap" << std::endl;
+		return false;
+	}
+	info.pixelDataOffset = readU32(data + 10);
+	uint32_t headerSize = readU32(data + 14);
+	if (headerSize < 12 || 14 + static_cast<size_t>(headerSize) > size) {
+		std::cerr << "[Error] Bitmap header is truncated" << std::endl;
+		return false;
+	}
+	const uint8_t* header = data + 14;
+	int32_t height;
+	size_t colourTableEntrySize = 4;
+	uint32_t coloursUsed = 0;
+	if (headerSize == 12) {
+		// BITMAPCOREHEADER
+		info.width = readU16(header + 4);
+		height = static_cast<int16_t>(readU16(header + 6));
+		info.bitsPerPixel = readU16(header + 10);
+		info.compression = BI_RGB;
+		colourTableEntrySize = 3;
+	}
+	else {
+		if (headerSize < 40) {
+			std::cerr << "[Error] Unsupported bitmap header size: " << headerSize << std::endl;
+			return false;
+		}
+		int32_t width = static_cast<int32_t>(readU32(header + 4));
+		if (width <= 0) {
+			std::cerr << "[Error] Invalid bitmap width: " << width << std::endl;
+			return false;
+		}
+		info.width = width;
+		height = static_cast<int32_t>(readU32(header + 8));
+		info.bitsPerPixel = readU16(header + 14);
+		info.compression = readU32(header + 16);
+		coloursUsed = readU32(header + 32);
+	}
+	info.topDown = height < 0;
+	info.height = height < 0 ? static_cast<uint32_t>(-static_cast<int64_t>(height)) : height;
+	if (info.width == 0 || info.height == 0) {
+		std::cerr << "[Error] Bitmap has no pixels" << std::endl;
+		return false;
+	}
+
+	switch (info.bitsPerPixel) {
+	case 1: case 4: case 8: case 16: case 24: case 32: break;
+	default:
+		std::cerr << "[Error] Unsupported bitmap bit depth: " << info.bitsPerPixel << std::endl;
+		return false;
+	}
+	bool bitfields = info.compression == BI_BITFIELDS || info.compression == BI_ALPHABITFIELDS;
+	if (!(info.compression == BI_RGB || (bitfields && (info.bitsPerPixel == 16 || info.bitsPerPixel == 32)))) {
+		std::cerr << "[Error] Unsupported bitmap compression: " << info.compression << std::endl;
+		return false;
+	}
+
+	// Default masks, replaced below for bitfield images
+	info.alphaMask = 0;
+	if (info.bitsPerPixel == 16) { info.redMask = 0x7c00; info.greenMask = 0x03e0; info.blueMask = 0x001f; }
+	else { info.redMask = 0x00ff0000; info.greenMask = 0x0000ff00; info.blueMask = 0x000000ff; }
+	if (bitfields) {
+		// The masks follow a 40 byte header, or are part of the header itself for V2 and later
+		size_t masksOffset = 14 + 40;
+		size_t maskCount = info.compression == BI_ALPHABITFIELDS ? 4 : 3;
+		if (headerSize >= 56) { maskCount = 4; }
+		if (masksOffset + maskCount * 4 > size) {
+			std::cerr << "[Error] Bitmap colour masks are truncated" << std::endl;
+			return false;
+		}
+		info.redMask = readU32(data + masksOffset);
+		info.greenMask = readU32(data + masksOffset + 4);
+		info.blueMask = readU32(data + masksOffset + 8);
+		if (maskCount == 4) { info.alphaMask = readU32(data + masksOffset + 12); }
+	}
+
+	info.palette.clear();
+	if (info.bitsPerPixel <= 8) {
+		uint32_t maxColours = 1u << info.bitsPerPixel;
+		uint32_t colourCount = (coloursUsed == 0 || coloursUsed > maxColours) ? maxColours : coloursUsed;
+		size_t tableOffset = 14 + static_cast<size_t>(headerSize);
+		if (headerSize == 40 && bitfields) { tableOffset += 12; }
+		if (tableOffset + colourCount * colourTableEntrySize > size) {
+			std::cerr << "[Error] Bitmap colour table is truncated" << std::endl;
+			return false;
+		}
+		info.palette.resize(maxColours, 0xff000000);
+		for (uint32_t i = 0; i < colourCount; i++) {
+			const uint8_t* entry = data + tableOffset + i * colourTableEntrySize;
+			info.palette[i] = 0xff000000 | static_cast<ARGB>(entry[2]) << 16 | static_cast<ARGB>(entry[1]) << 8 | entry[0];
+		}
+	}
+
+	info.sourceStride = ((static_cast<size_t>(info.width) * info.bitsPerPixel + 31) / 32) * 4;
+	if (info.pixelDataOffset > fileSize || info.sourceStride * info.height > fileSize - info.pixelDataOffset) {
+		std::cerr << "[Error] Bitmap pixel data is truncated" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Extracts a channel described by 'mask' and scales it to 8 bits
+static uint32_t maskedChannel(uint32_t pixel, uint32_t mask, uint32_t shift, uint32_t max) {
+	if (max == 0) { return 0; }
+	uint32_t value = (pixel & mask) >> shift;
+	if (max == 255) { return value; }
+	return (value * 255 + max / 2) / max;
+}
+
+void convertBMPRow(const BMPInfo& info, const uint8_t* source, ARGB* destination) {
+	uint32_t width = info.width;
+	switch (info.bitsPerPixel) {
+	case 1:
+	case 4:
+	case 8: {
+		uint32_t bits = info.bitsPerPixel;
+		uint32_t perByte = 8 / bits;
+		uint32_t mask = (1u << bits) - 1;
+		const ARGB* palette = info.palette.data();
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t shift = 8 - bits * (x % perByte + 1);
+			destination[x] = palette[(source[x / perByte] >> shift) & mask];
+		}
+		break;
+	}
+	case 24:
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t* pixel = source + x * 3;
+			destination[x] = 0xff000000 | static_cast<ARGB>(pixel[2]) << 16 | static_cast<ARGB>(pixel[1]) << 8 | pixel[0];
+		}
+		break;
+	case 16:
+	case 32: {
+		uint32_t shifts[4];
+		uint32_t maxima[4];
+		uint32_t masks[4] = { info.redMask, info.greenMask, info.blueMask, info.alphaMask };
+		for (int c = 0; c < 4; c++) {
+			shifts[c] = masks[c] == 0 ? 0 : std::countr_zero(masks[c]);
+			maxima[c] = masks[c] >> shifts[c];
+		}
+		// Plain 8 bits per channel BGRX / BGRA needs no per channel scaling
+		if (info.bitsPerPixel == 32 && info.redMask == 0x00ff0000 && info.greenMask == 0x0000ff00 && info.blueMask == 0x000000ff) {
+			uint32_t alphaFill = info.alphaMask == 0xff000000 ? 0 : 0xff000000;
+			for (uint32_t x = 0; x < width; x++) { destination[x] = readU32(source + x * 4) | alphaFill; }
+			break;
+		}
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t pixel = info.bitsPerPixel == 16 ? readU16(source + x * 2) : readU32(source + x * 4);
+			uint32_t red = maskedChannel(pixel, masks[0], shifts[0], maxima[0]);
+			uint32_t green = maskedChannel(pixel, masks[1], shifts[1], maxima[1]);
+			uint32_t blue = maskedChannel(pixel, masks[2], shifts[2], maxima[2]);
+			uint32_t alpha = masks[3] == 0 ? 0xff : maskedChannel(pixel, masks[3], shifts[3], maxima[3]);
+			destination[x] = alpha << 24 | red << 16 | green << 8 | blue;
+		}
+		break;
+	}
+	}
+}
+
+bool BMPView::open(const uint8_t* data, size_t size) {
+	if (!parseBMPHeader(data, size, info)) { return false; }
+	width = info.width;
+	rowReadCount = 0;
+	height = info.height;
+	const uint8_t* pixels = data + info.pixelDataOffset;
+	if (info.topDown) {
+		topRow = pixels;
+		stride = static_cast<ptrdiff_t>(info.sourceStride);
+	}
+	else {
+		topRow = pixels + (info.height - 1) * info.sourceStride;
+		stride = -static_cast<ptrdiff_t>(info.sourceStride);
+	}
+	rowBuffer.resize(width);
+	return true;
+}
+
+// Bytes of the source read per block of rows
+constexpr size_t rowReaderBlockBytes = size_t(1) << 20;
+// Most of the file before the pixel array that is read for the headers and colour table
+constexpr size_t rowReaderMaxHeaderBytes = size_t(1) << 16;
+
+bool BMPRowReader::open(const std::string& path) {
+	file.open(path, std::ios::binary | std::ios::ate);
+	if (!file) { return false; }
+	sizeBytes = static_cast<uint64_t>(file.tellg());
+	// The headers and colour table all come before the pixel array
+	uint8_t fileHeader[14] = {};
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(fileHeader), sizeof(fileHeader))) {
+		std::cerr << "[Error] File is not a bitmap" << std::endl;
+		return false;
+	}
+	size_t headerBytes = static_cast<size_t>(std::min<uint64_t>({ std::max<uint64_t>(readU32(fileHeader + 10), 14 + 124), sizeBytes, rowReaderMaxHeaderBytes }));
+	std::vector<uint8_t> headerData(headerBytes);
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(headerData.data()), headerBytes) || !parseBMPHeader(headerData.data(), headerBytes, sizeBytes, info)) { return false; }
+	width = info.width;
+	height = info.height;
+	rowsPerBlock = static_cast<uint32_t>(std::clamp<size_t>(rowReaderBlockBytes / std::max<size_t>(info.sourceStride, 1), 1, std::max<uint32_t>(height, 1)));
+	blockRows = 0;
+	rowReadCount = 0;
+	readFailed = false;
+	return true;
+}
+
+void BMPRowReader::readBlock(uint32_t y) const {
+	blockFirst = y / rowsPerBlock * rowsPerBlock;
+	blockRows = std::min(rowsPerBlock, height - blockFirst);
+	// The block's rows are contiguous in the file either way up; bottom-up files hold them last row first
+	uint64_t firstFileRow = info.topDown ? blockFirst : height - blockFirst - blockRows;
+	block.resize(static_cast<size_t>(blockRows) * info.sourceStride);
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(info.pixelDataOffset + firstFileRow * info.sourceStride));
+	if (!file.read(reinterpret_cast<char*>(block.data()), block.size())) {
+		std::fill(block.begin(), block.end(), uint8_t(0));
+		readFailed = true;
+	}
+}
+
+const uint8_t* BMPRowReader::rawRow(uint32_t y) const {
+	rowReadCount++;
+	if (blockRows == 0 || y < blockFirst || y - blockFirst >= blockRows) { readBlock(y); }
+	uint32_t index = info.topDown ? y - blockFirst : blockFirst + blockRows - 1 - y;
+	return block.data() + static_cast<size_t>(index) * info.sourceStride;
+}
+
+void BMPView::decode(Image& image) const {
+	image.width = width;
+	image.height = height;
+	image.pixels.resize(static_cast<size_t>(width) * height);
+	for (uint32_t y = 0; y < height; y++) {
+		convertBMPRow(info, rawRow(y), image.row(y));
+	}
+}
+
+bool decodeBMP(const uint8_t* data, size_t size, Image& image) {
+	BMPView view;
+	if (!view.open(data, size)) { return false; }
+	view.decode(image);
+	return true;
+}
+
+bool readBMP(const std::string& path, Image& image) {
+	MappedFile file;
+	if (!file.open(path)) { return false; }
+	return decodeBMP(file.data(), file.size(), image);
+}
+
+// The file and info headers of a bottom-up BI_RGB bitmap
+static void makeBMPHeader(uint32_t width, uint32_t height, int bitsPerPixel, size_t pixelDataSize, uint8_t header[54]) {
+	memset(header, 0, 54);
+	header[0] = 'B';
+	header[1] = 'M';
+	writeU32(header + 2, static_cast<uint32_t>(54 + pixelDataSize));
+	writeU32(header + 10, 54);
+	writeU32(header + 14, 40);
+	writeU32(header + 18, width);
+	writeU32(header + 22, height);
+	writeU16(header + 26, 1);
+	writeU16(header + 28, static_cast<uint16_t>(bitsPerPixel));
+	writeU32(header + 30, BI_RGB);
+	writeU32(header + 34, static_cast<uint32_t>(pixelDataSize));
+	writeU32(header + 38, 2835);	// 72 DPI
+	writeU32(header + 42, 2835);
+}
+
+// One ARGB row as the file stores it. Padding bytes past the pixels are left as they are.
+static void packBMPRow(const ARGB* row, uint32_t width, size_t bytesPerPixel, uint8_t* out) {
+	for (uint32_t x = 0; x < width; x++) {
+		uint8_t* pixel = out + x * bytesPerPixel;
+		pixel[0] = row[x] & 0xff;
+		pixel[1] = (row[x] >> 8) & 0xff;
+		pixel[2] = (row[x] >> 16) & 0xff;
+		if (bytesPerPixel == 4) { pixel[3] = row[x] >> 24; }
+	}
+}
+
+bool writeBMP(const std::string& path, const Image& image, int bitsPerPixel) {
+	if (bitsPerPixel != 24 && bitsPerPixel != 32) {
+		std::cerr << "[Error] Bitmaps can only be written with 24 or 32 bits per pixel" << std::endl;
+		return false;
+	}
+	size_t bytesPerPixel = bitsPerPixel / 8;
+	size_t stride = ((static_cast<size_t>(image.width) * bitsPerPixel + 31) / 32) * 4;
+	size_t pixelDataSize = stride * image.height;
+	uint8_t header[54];
+	makeBMPHeader(image.width, image.height, bitsPerPixel, pixelDataSize, header);
+
+	std::ofstream outputFile = std::ofstream(path, std::ios::binary);
+	if (!outputFile) {
+		std::cerr << "[Error] Failed to open output file: " << path << std::endl;
+		return false;
+	}
+	outputFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+	std::vector<uint8_t> rowBuffer(stride, 0);
+	for (uint32_t y = image.height; y-- > 0;) {
+		packBMPRow(image.row(y), image.width, bytesPerPixel, rowBuffer.data());
+		outputFile.write(reinterpret_cast<const char*>(rowBuffer.data()), stride);
+	}
+	if (!outputFile) {
+		std::cerr << "[Error] Failed to write output file: " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool BMPRowWriter::open(const std::string& path, uint32_t width, uint32_t height, int bitsPerPixel) {
+	if (bitsPerPixel != 24 && bitsPerPixel != 32) {
+		std::cerr << "[Error] Bitmaps can only be written with 24 or 32 bits per pixel" << std::endl;
+		return false;
+	}
+	this->width = width;
+	this->height = height;
+	filePath = path;
+	bytesPerPixel = bitsPerPixel / 8;
+	stride = ((static_cast<size_t>(width) * bitsPerPixel + 31) / 32) * 4;
+	rowBuffer.assign(stride, 0);
+	uint8_t header[54];
+	makeBMPHeader(width, height, bitsPerPixel, stride * height, header);
+
+	file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::cerr << "[Error] Failed to open output file: " << path << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	filePosition = sizeof(header);
+	return true;
+}
+
+void BMPRowWriter::writeRow(uint32_t y, const ARGB* row) {
+	// Rows are stored bottom-up, so rows written from the top seek back one row each time
+	uint64_t position = 54 + static_cast<uint64_t>(height - 1 - y) * stride;
+	if (position != filePosition) { file.seekp(static_cast<std::streamoff>(position)); }
+	packBMPRow(row, width, bytesPerPixel, rowBuffer.data());
+	file.write(reinterpret_cast<const char*>(rowBuffer.data()), stride);
+	filePosition = position + stride;
+}
+
+bool BMPRowWriter::close() {
+	file.close();
+	if (!file) {
+		std::cerr << "[Error] Failed to write output file: " << filePath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+Image resizeImage(const Image& source, uint32_t width, uint32_t height) {
+	Image resized;
+	resized.width = width;
+	resized.height = height;
+	resized.pixels.resize(static_cast<size_t>(width) * height);
+	if (source.width == 0 || source.height == 0) { return resized; }
+	// Sample positions are computed in 16.16 fixed point, aligning pixel centres
+	uint64_t xStep = (static_cast<uint64_t>(source.width) << 16) / width;
+	uint64_t yStep = (static_cast<uint64_t>(source.height) << 16) / height;
+	for (uint32_t y = 0; y < height; y++) {
+		int64_t sy = static_cast<int64_t>(y * yStep + yStep / 2) - 0x8000;
+		if (sy < 0) { sy = 0; }
+		uint32_t y0 = static_cast<uint32_t>(sy >> 16);
+		uint32_t y1 = y0 + 1 < source.height ? y0 + 1 : y0;
+		uint32_t fy = static_cast<uint32_t>(sy & 0xffff) >> 8;
+		const ARGB* row0 = source.row(y0);
+		const ARGB* row1 = source.row(y1);
+		ARGB* out = resized.row(y);
+		for (uint32_t x = 0; x < width; x++) {
+			int64_t sx = static_cast<int64_t>(x * xStep + xStep / 2) - 0x8000;
+			if (sx < 0) { sx = 0; }
+			uint32_t x0 = static_cast<uint32_t>(sx >> 16);
+			uint32_t x1 = x0 + 1 < source.width ? x0 + 1 : x0;
+			uint32_t fx = static_cast<uint32_t>(sx & 0xffff) >> 8;
+			ARGB result = 0;
+			for (int shift = 0; shift < 32; shift += 8) {
+				uint32_t c00 = (row0[x0] >> shift) & 0xff, c01 = (row0[x1] >> shift) & 0xff;
+				uint32_t c10 = (row1[x0] >> shift) & 0xff, c11 = (row1[x1] >> shift) & 0xff;
+				uint32_t top = c00 * (256 - fx) + c01 * fx;
+				uint32_t bottom = c10 * (256 - fx) + c11 * fx;
+				uint32_t value = (top * (256 - fy) + bottom * fy + (1 << 15)) >> 16;
+				result |= value << shift;
+			}
+			out[x] = result;
+		}
+	}
+	return resized;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "colorconverter.h"
+
+// 32bpp ARGB image with rows stored top-down and no padding between them
+struct Image {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<ARGB> pixels;
+
+	ARGB* row(uint32_t y) { return pixels.data() + static_cast<size_t>(y) * width; }
+	const ARGB* row(uint32_t y) const { return pixels.data() + static_cast<size_t>(y) * width; }
+};
+
+// Everything needed to interpret the pixel array of a BMP file
+struct BMPInfo {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	bool topDown = false;
+	uint16_t bitsPerPixel = 0;
+	uint32_t compression = 0;
+	uint32_t redMask = 0;
+	uint32_t greenMask = 0;
+	uint32_t blueMask = 0;
+	uint32_t alphaMask = 0;
+	std::vector<ARGB> palette;
+	size_t pixelDataOffset = 0;
+	size_t sourceStride = 0;	// bytes per row in the file, including padding
+};
+
+// Parses the file and info headers, colour masks and colour table. Supports 1/4/8-bit indexed,
+// 16-bit (555 or bitfields), 24-bit and 32-bit (plain or bitfields) images stored either way up.
+bool parseBMPHeader(const uint8_t* data, size_t size, BMPInfo& info);
+// The same for a file of 'fileSize' bytes of which 'data' only holds the first 'size', up to the pixel array
+bool parseBMPHeader(const uint8_t* data, size_t size, uint64_t fileSize, BMPInfo& info);
+// Converts one row of the file's pixel array to ARGB
+void convertBMPRow(const BMPInfo& info, const uint8_t* source, ARGB* destination);
+
+// Read-only view of a BMP held in memory, normally a mapped file. Rows are read in place: bottom-up files are
+// walked with a negative stride so row 0 is always the top of the image and nothing is flipped or copied.
+class BMPView {
+private:
+	BMPInfo info;
+	const uint8_t* topRow = nullptr;
+	ptrdiff_t stride = 0;
+	std::vector<ARGB> rowBuffer;
+	alignas(std::atomic_ref<uint64_t>::required_alignment) mutable uint64_t rowReadCount = 0;
+public:
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	bool open(const uint8_t* data, size_t size);
+	const BMPInfo& header() const { return info; }
+	// Row y in the file's own pixel format. Every row handed out is counted, from any thread.
+	const uint8_t* rawRow(uint32_t y) const {
+		std::atomic_ref<uint64_t>(rowReadCount).fetch_add(1, std::memory_order_relaxed);
+		return topRow + static_cast<ptrdiff_t>(y) * stride;
+	}
+	// Row y converted to ARGB. The pointer is valid until the next call.
+	const ARGB* row(uint32_t y) {
+		convertBMPRow(info, rawRow(y), rowBuffer.data());
+		return rowBuffer.data();
+	}
+	// Thread-safe form of row(y): converts into the caller's buffer of at least 'width' pixels
+	const ARGB* row(uint32_t y, ARGB* buffer) const {
+		convertBMPRow(info, rawRow(y), buffer);
+		return buffer;
+	}
+	void decode(Image& image) const;
+
+	// Rows read since the view was opened, sampled or not, so the passes made over the pixels can be reported
+	uint64_t rowReads() const { return std::atomic_ref<uint64_t>(rowReadCount).load(std::memory_order_relaxed); }
+	// Bytes of pixel data in a row, without the padding
+	size_t rowBytes() const { return (static_cast<size_t>(width) * info.bitsPerPixel + 7) / 8; }
+};
+
+// Reads a BMP's rows from the file as they are asked for, holding one block of rows at a time, for images too
+// large to map or keep in memory. Any order works, but top to bottom reads the file once. Not thread-safe.
+class BMPRowReader {
+private:
+	BMPInfo info;
+	mutable std::ifstream file;
+	mutable std::vector<uint8_t> block;	// rows [blockFirst, blockFirst + blockRows) in the file's own format
+	mutable uint32_t blockFirst = 0;
+	mutable uint32_t blockRows = 0;
+	uint32_t rowsPerBlock = 1;
+	mutable uint64_t rowReadCount = 0;
+	mutable bool readFailed = false;
+	uint64_t sizeBytes = 0;
+
+	void readBlock(uint32_t y) const;
+public:
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	bool open(const std::string& path);
+	const BMPInfo& header() const { return info; }
+	// Row y in the file's own pixel format. The pointer is valid until another row is read.
+	const uint8_t* rawRow(uint32_t y) const;
+	// Row y converted to ARGB in the caller's buffer of at least 'width' pixels
+	const ARGB* row(uint32_t y, ARGB* buffer) const {
+		convertBMPRow(info, rawRow(y), buffer);
+		return buffer;
+	}
+
+	uint64_t rowReads() const { return rowReadCount; }
+	size_t rowBytes() const { return (static_cast<size_t>(width) * info.bitsPerPixel + 7) / 8; }
+	uint64_t fileSize() const { return sizeBytes; }
+	// A read from the file failed since it was opened; the rows it should have filled read as zeros
+	bool failed() const { return readFailed; }
+};
+
+bool decodeBMP(const uint8_t* data, size_t size, Image& image);
+bool readBMP(const std::string& path, Image& image);
+// Writes a bottom-up BMP with 24 or 32 bits per pixel
+bool writeBMP(const std::string& path, const Image& image, int bitsPerPixel);
+
+// Writes a bottom-up BMP like writeBMP, one row at a time in any order, so an image can be written as it is
+// produced without holding it in memory. Every row must be written before close(). Not thread-safe.
+class BMPRowWriter {
+private:
+	std::ofstream file;
+	std::string filePath;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	size_t bytesPerPixel = 4;
+	size_t stride = 0;
+	std::vector<uint8_t> rowBuffer;
+	uint64_t filePosition = 0;
+public:
+	bool open(const std::string& path, uint32_t width, uint32_t height, int bitsPerPixel);
+	// Writes row y, counted from the top of the image
+	void writeRow(uint32_t y, const ARGB* row);
+	// Finishes the file. Returns false if any write failed.
+	bool close();
+};
+
+// Bilinear resample to the requested dimensions
+Image resizeImage(const Image& source, uint32_t width, uint32_t height);
@@ -0,0 +1,124 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// Fixed-capacity multi-producer, multi-consumer queue after Dmitry Vyukov's bounded MPMC design. Every cell carries
+// a sequence number saying whether it is free to write or ready to read, so producers and consumers each only
+// contend on one position counter and never take a lock. push() and pop() wait, spinning then sleeping, when the
+// queue is full or empty. Occupancy and stall counters are kept for reporting.
+template<typename T>
+class BoundedQueue {
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+	alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+	alignas(64) std::atomic<size_t> dequeuePos{ 0 };
+	alignas(64) std::atomic<bool> closed{ false };
+	std::atomic<uint64_t> pushes{ 0 };
+	std::atomic<uint64_t> occupancySum{ 0 };
+	std::atomic<uint64_t> fullStalls{ 0 };
+	std::atomic<uint64_t> emptyStalls{ 0 };
+
+	static void backOff(uint32_t& attempt) {
+		if (++attempt < 64) { std::this_thread::yield(); }
+		else { std::this_thread::sleep_for(std::chrono::microseconds(50)); }
+	}
+public:
+	// The capacity is rounded up to a power of two
+	explicit BoundedQueue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity) { size *= 2; }
+		cells = std::make_unique<Cell[]>(size);
+		for (size_t i = 0; i < size; i++) { cells[i].sequence.store(i, std::memory_order_relaxed); }
+		mask = size - 1;
+	}
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// Moves 'value' in and returns true, or returns false if the queue is full
+	bool tryPush(T& value) {
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		while (true) {
+			Cell& cell = cells[pos & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+			if (difference == 0) {
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.value = std::move(value);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) { return false; }
+			else { pos = enqueuePos.load(std::memory_order_relaxed); }
+		}
+	}
+	// Moves the oldest value out and returns true, or returns false if the queue is empty
+	bool tryPop(T& value) {
+		size_t pos = dequeuePos.load(std::memory_order_relaxed);
+		while (true) {
+			Cell& cell = cells[pos & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+			if (difference == 0) {
+				if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					value = std::move(cell.value);
+					cell.sequence.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) { return false; }
+			else { pos = dequeuePos.load(std::memory_order_relaxed); }
+		}
+	}
+
+	// Waits for room, then pushes
+	void push(T value) {
+		occupancySum.fetch_add(size(), std::memory_order_relaxed);
+		pushes.fetch_add(1, std::memory_order_relaxed);
+		if (tryPush(value)) { return; }
+		fullStalls.fetch_add(1, std::memory_order_relaxed);
+		uint32_t attempt = 0;
+		while (!tryPush(value)) { backOff(attempt); }
+	}
+	// Waits for a value. Returns false once the queue has been closed and emptied.
+	bool pop(T& value) {
+		if (tryPop(value)) { return true; }
+		emptyStalls.fetch_add(1, std::memory_order_relaxed);
+		uint32_t attempt = 0;
+		while (true) {
+			if (tryPop(value)) { return true; }
+			// Anything pushed before close() is visible once closed is, so one more try settles it
+			if (closed.load(std::memory_order_acquire)) { return tryPop(value); }
+			backOff(attempt);
+		}
+	}
+	// Called by the producers once they are all done pushing
+	void close() { closed.store(true, std::memory_order_release); }
+
+	size_t capacity() const { return mask + 1; }
+	// Approximate while other threads are pushing or popping
+	size_t size() const {
+		size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+		size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+	// Mean number of queued values seen by each push
+	double averageOccupancy() const {
+		uint64_t count = pushes.load(std::memory_order_relaxed);
+		return count == 0 ? 0.0 : static_cast<double>(occupancySum.load(std::memory_order_relaxed)) / count;
+	}
+	// Pushes that found the queue full
+	uint64_t fullStallCount() const { return fullStalls.load(std::memory_order_relaxed); }
+	// Pops that found the queue empty
+	uint64_t emptyStallCount() const { return emptyStalls.load(std::memory_order_relaxed); }
+};
@@ -1,23 +1,59 @@
-#define GDIPVER 0x0110
-#include "wingdiputils.h"
-#pragma comment (lib,"Gdiplus.lib")
 #include <fstream>
 #include <iostream>
-#include <set>
+#include <chrono>
+#include <algorithm>
 #include <bitset>
+#include <type_traits>
+#include <optional>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <span>
+#include <array>
+#include <filesystem>
+#include <cctype>
+#include <cmath>
+#include <limits>
 #include "libCLI.h"
 #include "colorconverter.h"
+#include "colourkernels.h"
+#include "bitvector.h"
+#include "bmp.h"
+#include "colourhistogram.h"
+#include "paletteindexmap.h"
+#include "quantiser.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+#include "boundedqueue.h"
+#include "arena.h"
+#include "rle.h"
+#include "rleiheader.h"
+#include "rans.h"
+#include "prediction.h"
+#include "dither.h"
+#include "decoder.h"
 #include "cli.h"
 
-namespace gdip = Gdiplus;
-
 struct CLIArg cliArgCfg[] = {
 	CLIArg{ "-w", "--width", "Width of the output image (px)", std::optional<int>(std::nullopt), false },
 	CLIArg{ "-h", "--height", "Height of the output image (px)", std::optional<int>(std::nullopt), false },
-	CLIArg{ "-c", "--colour-format", "Format of outputted colours - Options: pi1, pi2, pi4, i8r1, i8r2, pg1, pg2, pc3, pg3, pg4, pc6, c555r1 c555r2, c565r1, c565r2, c24r1, c24r2", std::optional<std::string>(std::nullopt), true },
+	CLIArg{ "-c", "--colour-format", "Format of outputted colours - Options: pi1, pi2, pi4, i8r1, i8r2, pg1, pg2, pc3, pg3, pg4, pc6, c555r1 c555r2, c565r1, c565r2, c24r1, c24r2, pi1e, pi2e, pi4e, i8e, pg1e, pg2e, pc3e, pg3e, pg4e, pc6e, c555e, c565e, c24e (Exp-Golomb run lengths), auto (smallest lossless, or see --min-psnr)", std::optional<std::string>(std::nullopt), true },
 	CLIArg{ "-p", "--palette-format", "Format of palette colours - Options: g2, c3, g3, g4, c6, c555, c565, c24", std::optional<std::string>(std::nullopt), false },
 	CLIArg{ "-s", "--source", "File path of input image", std::optional<std::string>(std::nullopt), true },
 	CLIArg{ "-d", "--destination", "File path of output image", std::optional<std::string>(std::nullopt), true },
+	CLIArg{ "-q", "--quantiser", "Palette generation method for indexed formats - Options: median-cut (default), octree, popularity", std::optional<std::string>(std::nullopt), false },
+	CLIArg{ "-t", "--dither", "Dithering for pc3, pc6 and pg1 to pg4 - Options: none (default), ordered, floyd-steinberg", std::optional<std::string>(std::nullopt), false },
+	CLIArg{ "-k", "--run-tolerance", "For pc3, pc6 and pg1 to pg4, repeat the previous pixel's colour while it is within this much (0 to 255) of the pixel on every channel, giving longer runs; only values over half a level step matter without ordered dithering (default: 0)", std::optional<int>(std::nullopt), false },
+	CLIArg{ "-u", "--run-report", "Print the estimated size and PSNR of the chosen low-bit format at a range of --run-tolerance values", std::optional<bool>(std::nullopt), false },
+	CLIArg{ "-n", "--sample-step", "Build the palette from every n-th pixel of every n-th row (default: automatic above 4 megapixels)", std::optional<int>(std::nullopt), false },
+	CLIArg{ "-j", "--threads", "Worker threads for encoding large images and decoding striped ones (default: one per hardware thread, 1 encodes serially)", std::optional<int>(std::nullopt), false },
+	CLIArg{ "-b", "--batch", "Compress every .bmp in the --source directory (or listed one per line in a --source manifest file) into the --destination directory", std::optional<bool>(std::nullopt), false },
+	CLIArg{ "-m", "--min-psnr", "With -c auto, also accept lossy formats scoring at least this PSNR (dB) on the sampled rows", std::optional<int>(std::nullopt), false },
+	CLIArg{ "-r", "--stripe-rows", "Write a version 2 file split into independently decodable stripes of this many rows", std::optional<int>(std::nullopt), false },
+	CLIArg{ "-f", "--predict", "Code each stripe's rows as differences from the row above or the pixel to the left (up, left or Paeth, whichever is smallest) (default stripes: 256 rows)", std::optional<bool>(std::nullopt), false },
+	CLIArg{ "-e", "--entropy", "rANS code the run-length codes of each stripe, writing a version 3 file (default stripes: 256 rows)", std::optional<bool>(std::nullopt), false },
+	CLIArg{ "-z", "--stream", "Compress or decompress without holding the image or its output in memory, reading and writing a few rows at a time, for images larger than RAM (one thread, no resizing)", std::optional<bool>(std::nullopt), false },
+	CLIArg{ "-x", "--decompress", "Decompress the source .rlei file into a bitmap", std::optional<bool>(std::nullopt), false },
 };
 const char* defaultArgv[] = {
 	"-s",
@@ -44,75 +80,6 @@ bool getFromVariantOptional(const std::variant<Types...>& source, T* dest) {
 }
 
 
-class bitvector : public std::vector<bool> {
-public:
-	using vector::vector;
-	template<size_t size>
-	void push_many_back(std::bitset<size> bs) {
-		for (int i = size - 1; i >= 0; i--) {
-			this->push_back(bs[i]);
-		}
-	}
-	void push_many_back(bitvector bv) {
-		this->insert(this->end(), bv.begin(), bv.end());
-	}
-	void push_many_back(uint64_t src, uint32_t count) {
-		if (count > 64) { count = 64; }
-		for (int i = count - 1; i >= 0; i--) {
-			this->push_back(src >> i & 0x1);
-		}
-	}
-	uint8_t* dump(uint8_t* out, size_t size) {
-		size_t dumpSize = ((size * 8) > this->size()) ? (this->size()) : (size * 8);
-		if (dumpSize <= 0) {
-			return nullptr;
-		}
-		uint8_t buf = 0x0;
-		size_t bufUsage = 0;
-		size_t bitPos = 0;
-		size_t bytePos = 0;
-		for (bitPos = 0; bitPos <= dumpSize - 1; bitPos++) {
-			buf <<= 1;
-			buf |= this->at(bitPos);
-			bufUsage++;
-			if (bufUsage >= 8) {
-				out[bytePos] = buf;
-				buf = 0;
-				bufUsage = 0;
-			}
-		}
-		if (bufUsage > 0) {
-			out[bytePos] = buf << 8 - bufUsage;
-		}
-		return out;
-	}
-	std::vector<uint8_t> dump() {
-		std::vector<uint8_t> out = std::vector<uint8_t>(0);
-		if (this->size() == 0) { return out; }
-		uint8_t buf = 0x0;
-		size_t bufUsage = 0;
-		size_t bitPos = 0;
-		size_t bytePos = 0;
-		for (bitPos = 0; bitPos <= this->size() - 1; bitPos++) {
-			buf <<= 1;
-			buf |= this->at(bitPos);
-			bufUsage++;
-			if (bufUsage >= 8) {
-				out.push_back(buf);
-				buf = 0;
-				bufUsage = 0;
-			}
-		}
-		if (bufUsage > 0) {
-			out[bytePos] = buf << 8 - bufUsage;
-		}
-		return out;
-	}
-	size_t byte_size() {
-		return ceilf(this->size() / 8.0);
-	}
-};
-
 template<typename T>
 void printVector(std::vector<T> vec, int width) {
 	for (int i = 0; i < vec.size(); i++) {
@@ -129,191 +96,75 @@ void printVectorInt(std::vector<T> vec, int width) {
 }
 
 bitvector runLengthEncode(bitvector& bits, int unitLength, int packLength) {
-	if (packLength < unitLength) { return bitvector(0); }
-	size_t packingSpace = packLength - unitLength;
-	int maxRLEValue = exp2(packingSpace) - 1;
-	bitvector res;
-	auto bitsBegin = bits.cbegin();
-	bitvector run = bitvector(bitsBegin, bitsBegin + unitLength);
-	int length = 0;
-
-
-	bitvector slice = bitvector(unitLength);
-	for (int i = 0; i < bits.size(); i += unitLength) {
-		slice = bitvector(bitsBegin + i, bitsBegin + i + unitLength);
-		if (run == slice) { length++; continue; }
-		else {
-			while (length > maxRLEValue) {
-				for (int packBit = 0; packBit < packingSpace; packBit++) {
-					run.push_back(1);
-				}
-				res.insert(res.end(), run.begin(), run.end());
-				length -= maxRLEValue;
-			}
-			run.push_many_back(length, packingSpace);
-			res.insert(res.end(), run.begin(), run.end());
-			length = 1;
-
-			run = slice;
-		}
-	}
-	while (length > maxRLEValue) {
-		for (int packBit = 0; packBit < packingSpace; packBit++) {
-			run.push_back(1);
-		}
-		res.insert(res.end(), run.begin(), run.end());
-		length -= maxRLEValue;
+	if (!RunLengthEncoder::validLengths(unitLength, packLength)) { return bitvector(); }
+	bitvector res = bitvector(bits.size());
+	RunLengthEncoder encoder = RunLengthEncoder(res, unitLength, packLength);
+	for (size_t i = 0; i + unitLength <= bits.size(); i += unitLength) {
+		encoder.push(static_cast<uint32_t>(bits.get_many(i, unitLength)));
 	}
-	run.push_many_back(length, packingSpace);
-	res.insert(res.end(), run.begin(), run.end());
+	encoder.finish();
 	return res;
 }
-bitvector runLengthDecode(bitvector& bits, int unitLength, int packLength) {
-	if (packLength < unitLength) { return bitvector(0); }
-	auto bitsBegin = bits.cbegin();
-	bitvector decoded = bitvector();
-	uint8_t* repeatsMemory = nullptr;
-	size_t repeatsMemorySize = 0;
-	for (int i = 0; i < bits.size(); i += packLength) {
-		bitvector packed = bitvector(bitsBegin + i, bitsBegin + i + packLength);
-		bitvector value = bitvector(packed.begin(), packed.begin() + unitLength);
-		bitvector repeats = bitvector(packed.begin() + unitLength, packed.begin() + packLength);
-		if (repeatsMemory == nullptr || repeatsMemorySize == 0) {
-			repeatsMemorySize = ceilf(repeats.size() / 8.0);
-			repeatsMemory = static_cast<uint8_t*>(malloc(repeatsMemorySize));
-		}
-		repeats.dump(repeatsMemory, repeatsMemorySize);
-		if (repeatsMemorySize == 1) {
-			for (int repeatNo = 0; repeatNo < *(reinterpret_cast<uint8_t*>(repeatsMemory)); repeatNo++) {
-				decoded.push_many_back(value);
-			}
-		}
-		else if (repeatsMemorySize == 2) {
-			for (int repeatNo = 0; repeatNo < *(reinterpret_cast<uint16_t*>(repeatsMemory)); repeatNo++) {
-				decoded.push_many_back(value);
-			}
-		}
-		else if (repeatsMemorySize == 4) {
-			for (int repeatNo = 0; repeatNo < *(reinterpret_cast<uint32_t*>(repeatsMemory)); repeatNo++) {
-				decoded.push_many_back(value);
-			}
-		}
-	}
-	free(repeatsMemory);
-	return decoded;
-}
-
-// Custom deleter to properly free the allocated memory
-struct ColorPaletteDeleter {
-	void operator()(Gdiplus::ColorPalette* palette) const {
-		delete[] palette;
-	}
-};
-std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> allocatePalette(int colors, uint32_t flags) {
-	size_t paletteSize = sizeof(gdip::ColorPalette) + (colors - 1) * sizeof(gdip::ARGB);
-	//gdip::ColorPalette* palette = (gdip::ColorPalette*)malloc(paletteSize);
-	gdip::ColorPalette* palette = reinterpret_cast<gdip::ColorPalette*>(new uint8_t[paletteSize]);
-	palette->Count = colors;
-	palette->Flags = flags;
-	return std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter>(palette);
-}
-std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> allocatePalette(size_t paletteSize, uint32_t flags) {
-	//gdip::ColorPalette* palette = (gdip::ColorPalette*)malloc(paletteSize);
-	gdip::ColorPalette* palette = reinterpret_cast<gdip::ColorPalette*>(new uint8_t[paletteSize]);
-	palette->Count = (paletteSize - (sizeof(gdip::ColorPalette) - sizeof(gdip::ARGB))) / sizeof(gdip::ARGB);
-	palette->Flags = flags;
-	return std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter>(palette);
-}
-
-
-std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> makeSmallOptimalPalette(size_t maxSize, gdip::Bitmap& image, bool imageIsGreyscale) {
+std::vector<ARGB> makeSmallOptimalPalette(size_t maxSize, const ColourHistogram& histogram, QuantiserMethod method) {
 
 	if (maxSize > 256) { maxSize = 256; } //Image Palettes larger than 256 are not supported.
 
-	std::set<gdip::ARGB> uniqueColors;
-
-	int width = image.GetWidth();
-	int height = image.GetHeight();
-
-	gdip::BitmapData bitmapData;
-	gdip::Rect rect(0, 0, width, height);
-	image.LockBits(&rect, gdip::ImageLockModeRead, PixelFormat32bppARGB, &bitmapData);
-
-	// Iterate through the pixels to find unique colors
-	for (int y = 0; y < height; ++y)
-	{
-		uint8_t* row = (uint8_t*)bitmapData.Scan0 + y * bitmapData.Stride;
-		for (uint8_t x = 0; x < width; ++x)
-		{
-			gdip::ARGB color = *(gdip::ARGB*)(row + x * 4);
-			uniqueColors.insert(color);
-		}
-	}
-
-	image.UnlockBits(&bitmapData);
-
-	if (uniqueColors.size() < 1 || maxSize < 1) {
-		return nullptr;
-	}
-	auto palette = allocatePalette(static_cast<int>(min(maxSize, uniqueColors.size())), imageIsGreyscale ? gdip::PaletteFlagsGrayScale : 0);
-
-	gdip::Bitmap::InitializePalette(palette.get(), gdip::PaletteTypeOptimal, min(maxSize, uniqueColors.size()), false, &image);
-	
-	return palette;
+	// The palette is sorted so palette order matches LUT order
+	return quantiseColours(histogram, maxSize, method);
 }
-bitvector makeOutputPalette(std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter>& inputPalette, CompressedImagePaletteFormat paletteFormat) {
+bitvector makeOutputPalette(const std::vector<ARGB>& inputPalette, CompressedImagePaletteFormat paletteFormat) {
 	bitvector palette = bitvector();
 	switch (paletteFormat) {
 	case CompressedImagePaletteFormat::noPalette: {
 		std::cerr << "[Error] Tried to make palette with format of 'No Palette'" << std::endl;
-		return bitvector(0);
+		return bitvector();
 		break;
 	}
 	case CompressedImagePaletteFormat::greyscale2Bit: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			palette.push_many_back(std::bitset<2>(ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toGreyscale2Bit()));
+		for (ARGB entry : inputPalette) {
+			palette.push_many_back(std::bitset<2>(ConvertibleColour().fromColourARGB(entry)->toGreyscale2Bit()));
 		}
 		break;
 	}
 	case CompressedImagePaletteFormat::greyscale3Bit: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			palette.push_many_back(std::bitset<3>(ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toGreyscale3Bit()));
+		for (ARGB entry : inputPalette) {
+			palette.push_many_back(std::bitset<3>(ConvertibleColour().fromColourARGB(entry)->toGreyscale3Bit()));
 		}
 		break;
 	}
 	case CompressedImagePaletteFormat::greyscale4Bit: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			palette.push_many_back(std::bitset<4>(ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toGreyscale4Bit()));
+		for (ARGB entry : inputPalette) {
+			palette.push_many_back(std::bitset<4>(ConvertibleColour().fromColourARGB(entry)->toGreyscale4Bit()));
 		}
 		break;
 	}
 	case CompressedImagePaletteFormat::colour3Bit: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			palette.push_many_back(std::bitset<3>(ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toColour3Bit()));
+		for (ARGB entry : inputPalette) {
+			palette.push_many_back(std::bitset<3>(ConvertibleColour().fromColourARGB(entry)->toColour3Bit()));
 		}
 		break;
 	}
 	case CompressedImagePaletteFormat::colour6Bit: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			palette.push_many_back(std::bitset<6>(ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toColour6Bit()));
+		for (ARGB entry : inputPalette) {
+			palette.push_many_back(std::bitset<6>(ConvertibleColour().fromColourARGB(entry)->toColour6Bit()));
 		}
 		break;
 	}
 	case CompressedImagePaletteFormat::colour555: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			palette.push_many_back(std::bitset<16>(ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toColour555()));
+		for (ARGB entry : inputPalette) {
+			palette.push_many_back(std::bitset<16>(ConvertibleColour().fromColourARGB(entry)->toColour555()));
 		}
 		break;
 	}
 	case CompressedImagePaletteFormat::colour565: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			palette.push_many_back(std::bitset<16>(ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toColour565()));
+		for (ARGB entry : inputPalette) {
+			palette.push_many_back(std::bitset<16>(ConvertibleColour().fromColourARGB(entry)->toColour565()));
 		}
 		break;
 	}
 	case CompressedImagePaletteFormat::colourFull: {
-		for (int i = 0; i < inputPalette->Count; i++) {
-			ConvertibleColour::colour24_t col = ConvertibleColour().fromColourARGB(inputPalette->Entries[i])->toColour24Bit();
+		for (ARGB entry : inputPalette) {
+			ConvertibleColour::colour24_t col = ConvertibleColour().fromColourARGB(entry)->toColour24Bit();
 			palette.push_many_back(std::bitset<8>(col.R));
 			palette.push_many_back(std::bitset<8>(col.G));
 			palette.push_many_back(std::bitset<8>(col.B));
@@ -323,480 +174,1320 @@ bitvector makeOutputPalette(std::unique_ptr<gdip::ColorPalette, ColorPaletteDele
 	}
 	return palette;
 }
-std::set<gdip::ARGB> makePaletteLUT(gdip::ColorPalette* palette) {
-	std::set<gdip::ARGB> LUT;
-	auto paletteIter = palette->Entries;
-	size_t formatSize = 32;	//gdip::ColorPalettes are always stored using gdip::ARGB, which is an alias for uint32_t 
-	for (int i = 0; i < palette->Count; i++) {
-		gdip::ARGB colour = static_cast<gdip::ARGB*>(palette->Entries)[i];
-		LUT.insert(colour);
-	}
-	return LUT;
+PaletteIndexMap makePaletteLUT(const std::vector<ARGB>& palette) {
+	return PaletteIndexMap(palette);
 }
-std::set<gdip::ARGB> getImageColours(gdip::Bitmap* bitmap) {
 
-	std::set<gdip::ARGB> LUT;
-	bitmap->ConvertFormat(PixelFormat32bppARGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-	gdip::BitmapData bitmapData;
-	gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-	bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
+// Row y as ARGB. BMPView rows are converted into 'buffer', so every thread needs its own. BMPRowReader rows
+// come from the file and may only be read from one thread.
+inline const ARGB* rowPixels(const Image& image, uint32_t y, ARGB*) { return image.row(y); }
+inline const ARGB* rowPixels(const BMPView& view, uint32_t y, ARGB* buffer) { return view.row(y, buffer); }
+inline const ARGB* rowPixels(const BMPRowReader& reader, uint32_t y, ARGB* buffer) { return reader.row(y, buffer); }
 
-	for (int y = 0; y < bitmapData.Height; y++) {
-		for (int x = 0; x < bitmapData.Width; x++) {
-			gdip::ARGB colour = *(static_cast<gdip::ARGB*>(bitmapData.Scan0) + y * bitmapData.Stride + x);
-			LUT.insert(colour);
+// Pixel consumers below accept anything rowPixels can read rows of - an Image, a BMPView or a BMPRowReader
+// With a sampleStep above 1 only every sampleStep-th pixel of every sampleStep-th row is counted
+template<typename Pixels>
+ColourHistogram getImageColours(const Pixels& image, uint32_t sampleStep = 1) {
+	ColourHistogram histogram;
+	if constexpr (std::is_same_v<Pixels, BMPView>) {
+		if (countColours16Bit(image, histogram, sampleStep)) { return histogram; }
+	}
+	ScratchVector<ARGB> rowBuffer(image.width);
+	for (uint32_t y = 0; y < image.height; y += sampleStep) {
+		const ARGB* row = rowPixels(image, y, rowBuffer.data());
+		if (sampleStep == 1) { histogram.addRow(row, image.width); continue; }
+		for (uint32_t x = 0; x < image.width; x += sampleStep) { histogram.add(row[x]); }
+	}
+	return histogram;
+}
+// Index of the palette entry closest to 'colour' by squared RGB distance
+size_t nearestPaletteIndex(const std::vector<ARGB>& palette, ARGB colour) {
+	size_t bestIndex = 0;
+	uint32_t bestDistance = UINT32_MAX;
+	for (size_t i = 0; i < palette.size(); i++) {
+		int dr = static_cast<int>((colour >> 16) & 0xff) - static_cast<int>((palette[i] >> 16) & 0xff);
+		int dg = static_cast<int>((colour >> 8) & 0xff) - static_cast<int>((palette[i] >> 8) & 0xff);
+		int db = static_cast<int>(colour & 0xff) - static_cast<int>(palette[i] & 0xff);
+		uint32_t distance = dr * dr + dg * dg + db * db;
+		if (distance < bestDistance) {
+			bestDistance = distance;
+			bestIndex = i;
 		}
 	}
-	return LUT;
+	return bestIndex;
 }
 
-struct indexedImage {
-	bitvector palette;
-	CompressedImagePaletteFormat paletteFormat;
-	size_t paletteBitWidth;
-	bitvector image;
+
+struct PaletteOptions {
+	QuantiserMethod quantiser = QuantiserMethod::medianCut;
+	uint32_t sampleStep = 0;	// 0 picks a step based on the image size
 };
-indexedImage convertBitmapToFullPalette(gdip::Bitmap* bitmap, size_t paletteBitWidth, CompressedImagePaletteFormat paletteFormatDesired) {
-	bitmap->ConvertFormat(PixelFormat32bppARGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-	std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> extractedPalette = makeSmallOptimalPalette(1 << paletteBitWidth, *bitmap, false);
-	bitvector outputPalette = makeOutputPalette(extractedPalette, paletteFormatDesired);
-	
-	gdip::BitmapData bitmapData;
-	gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-	bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
 
-	bitvector convertedBitmap = bitvector(bitmapData.Width * bitmapData.Height * 8);
-	auto paletteLUT = makePaletteLUT(extractedPalette.get()); //This _should_ preserve the ordering of the palette.
-	for (int x = 0; x < bitmapData.Width; x++) for (int y = 0; y < bitmapData.Height; y++) {
-		gdip::ARGB col = *(static_cast<gdip::ARGB*>(bitmapData.Scan0) + y * bitmapData.Stride + x);
-		auto iter = paletteLUT.find(col);
-		int index = std::distance(paletteLUT.begin(), iter);
-		convertedBitmap.push_many_back(index, paletteBitWidth);
+// Everything needed to turn rows of pixels into units, worked out once per image
+struct UnitFormat {
+	CompressedImageColourFormat colourFormat;
+	std::vector<ARGB> palette;	// indexed formats only
+	std::optional<PaletteIndexMap> paletteLUT;
+	bool exactPalette = false;	// every colour in the image is known to be in the palette
+	DitherMethod dither = DitherMethod::none;	// direct low-bit formats only
+	uint8_t runTolerance = 0;	// direct low-bit formats only, see keepRuns
+	ScratchVector<uint8_t> ditheredUnits;	// the whole image's units, when Floyd-Steinberg dithered
+	std::unique_ptr<FloydSteinbergRows> rowDither;	// instead of ditheredUnits when streaming; rows must be encoded in order
+};
+
+// The colours of one image, counted once and shared by everything that builds a palette for it
+struct ImageColours {
+	ColourHistogram histogram;
+	uint32_t sampleStep = 1;
+	std::chrono::duration<double, std::milli> countTime{};
+};
+
+template<typename Pixels>
+ImageColours countImageColours(const Pixels& pixels, const PaletteOptions& paletteOptions) {
+	ImageColours colours;
+	// Very large images only sample around a million pixels for the palette
+	colours.sampleStep = paletteOptions.sampleStep;
+	if (colours.sampleStep == 0) {
+		uint64_t pixelCount = static_cast<uint64_t>(pixels.width) * pixels.height;
+		colours.sampleStep = 1;
+		if (pixelCount > (uint64_t(1) << 22)) {
+			while (pixelCount / (static_cast<uint64_t>(colours.sampleStep) * colours.sampleStep) > (uint64_t(1) << 20)) { colours.sampleStep++; }
+		}
 	}
-	return { outputPalette, paletteFormatDesired, paletteBitWidth, convertedBitmap };
+	auto start = std::chrono::steady_clock::now();
+	colours.histogram = getImageColours(pixels, colours.sampleStep);
+	colours.countTime = std::chrono::steady_clock::now() - start;
+	return colours;
+}
+
+// Builds the palette for indexed formats from the image's colours, writing its entries to outputPalette
+UnitFormat prepareUnitFormat(const ImageColours* colours, CompressedImageColourFormat colourFormatDesired, uint8_t paletteBitWidth, CompressedImagePaletteFormat paletteFormatDesired, QuantiserMethod quantiser, bool verbose, bitvector& outputPalette) {
+	UnitFormat format;
+	format.colourFormat = colourFormatDesired;
+	if (paletteBitWidth == 0) { return format; }
+
+	auto quantiseStart = std::chrono::steady_clock::now();
+	format.palette = makeSmallOptimalPalette(1 << static_cast<uint32_t>(paletteBitWidth), colours->histogram, quantiser);
+	format.paletteLUT.emplace(makePaletteLUT(format.palette));
+	// A sampled histogram may have missed colours, so only an exact one can prove the palette covers the image
+	format.exactPalette = colours->sampleStep == 1 && colours->histogram.size() <= format.paletteLUT->size();
+	outputPalette = makeOutputPalette(format.palette, paletteFormatDesired);
+	std::chrono::duration<double, std::milli> quantiseTime = std::chrono::steady_clock::now() - quantiseStart;
 
+	if (!verbose) { return format; }
+	std::cout << "[Info] Palette of " << format.palette.size() << " colours from " << colours->histogram.size() << " unique (sample step " << colours->sampleStep << ")" << std::endl;
+	std::cout << "[Info] Histogram: " << colours->countTime.count() << "ms, Quantise: " << quantiseTime.count() << "ms" << std::endl;
+	return format;
 }
-indexedImage convertBitmapToPalette(gdip::Bitmap* bitmap, size_t paletteBitWidth, CompressedImagePaletteFormat paletteFormatDesired) {
-	bitmap->ConvertFormat(PixelFormat32bppARGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-	std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> extractedPalette = makeSmallOptimalPalette(1 << paletteBitWidth, *bitmap, false);
-	bitvector outputPalette = makeOutputPalette(extractedPalette, paletteFormatDesired);
 
-	bitmap->ConvertFormat(PixelFormat8bppIndexed, gdip::DitherTypeSolid, gdip::PaletteTypeCustom, extractedPalette.get(), 0);
-	gdip::BitmapData bitmapData;
-	gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-	bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
+// Sets up dithering and run-friendly quantisation for the direct low-bit formats. Floyd-Steinberg dithers the
+// whole image here, since each row depends on the one above it, unless 'streaming' asks for it to be done as
+// the rows are encoded, in order; everything else is done row by row as the rows are encoded.
+template<typename Pixels>
+void prepareLowBitQuantisation(const Pixels& pixels, DitherMethod dither, uint8_t runTolerance, WorkStealingPool* pool, bool streaming, bool verbose, UnitFormat& format) {
+	if (!ditherable(format.colourFormat)) { return; }
+	format.dither = dither;
+	format.runTolerance = runTolerance;
+	if (dither != DitherMethod::floydSteinberg) { return; }
+	if (streaming) {
+		format.rowDither = std::make_unique<FloydSteinbergRows>(format.colourFormat, pixels.width, runTolerance);
+		return;
+	}
 
-	bitvector convertedBitmap = bitvector(bitmapData.Width * bitmapData.Height * 8);
+	auto ditherStart = std::chrono::steady_clock::now();
+	format.ditheredUnits.resize(static_cast<size_t>(pixels.width) * pixels.height);
+	ditherFloydSteinberg(format.colourFormat, pixels.width, pixels.height, runTolerance, [&pixels](uint32_t y, ARGB* buffer) { return rowPixels(pixels, y, buffer); }, pool, format.ditheredUnits.data());
+	std::chrono::duration<double, std::milli> ditherTime = std::chrono::steady_clock::now() - ditherStart;
+	if (verbose) { std::cout << "[Info] Floyd-Steinberg dithered " << pixels.height << " rows in " << ditherTime.count() << "ms" << std::endl; }
+}
 
-	for (int y = 0; y < bitmapData.Height; y++) {
-		for (int x = 0; x < bitmapData.Width; x++) {
-			convertedBitmap.push_many_back(*(static_cast<uint8_t*>(bitmapData.Scan0) + y * bitmapData.Stride + x), 4);
+// 24bpp bitmaps are packed straight from the file's bytes, everything else goes through ARGB rows
+template<typename Pixels>
+void packRow16(const Pixels& pixels, uint32_t y, bool is565, ARGB* rowBuffer, uint16_t* units) {
+	if constexpr (std::is_same_v<Pixels, BMPView>) {
+		if (pixels.header().bitsPerPixel == 24) {
+			if (is565) { rowBGRToColour565(pixels.rawRow(y), pixels.width, units); }
+			else { rowBGRToColour555(pixels.rawRow(y), pixels.width, units); }
+			return;
 		}
 	}
-	return { outputPalette, paletteFormatDesired, paletteBitWidth, convertedBitmap };
+	if (is565) { rowToColour565(rowPixels(pixels, y, rowBuffer), pixels.width, units); }
+	else { rowToColour555(rowPixels(pixels, y, rowBuffer), pixels.width, units); }
 }
 
+// One row of a direct low-bit format, which is dithered and keeps runs as 'format' asks
+void quantiseLowBitRow(const UnitFormat& format, const ARGB* row, uint32_t width, uint32_t y, uint8_t* units) {
+	// Keeps runs itself
+	if (format.rowDither) {
+		format.rowDither->ditherRow(row, units);
+		return;
+	}
+	if (format.dither == DitherMethod::ordered) { ditherRowOrdered(format.colourFormat, row, width, y, units); }
+	else {
+		switch (format.colourFormat) {
+		case CompressedImageColourFormat::packedColour3Bit: rowToColour3Bit(row, width, units); break;
+		case CompressedImageColourFormat::packedColour6Bit: rowToColour6Bit(row, width, units); break;
+		case CompressedImageColourFormat::packedGreyscale1Bit: rowToGreyscale(row, width, 1, units); break;
+		case CompressedImageColourFormat::packedGreyscale2Bit: rowToGreyscale(row, width, 2, units); break;
+		case CompressedImageColourFormat::packedGreyscale3Bit: rowToGreyscale(row, width, 3, units); break;
+		default: rowToGreyscale(row, width, 4, units); break;
+		}
+	}
+	keepRuns(format.colourFormat, format.runTolerance, row, width, units);
+}
 
-int main(int argc, const char** argv)
-{
-	std::unordered_map<std::string, CLIArg> cliArgs;
-	if (argc <= 1) {
-		cliArgs = parseArgs(sizeof(defaultArgv) / sizeof(defaultArgv[0]), defaultArgv, sizeof(cliArgCfg) / sizeof(cliArgCfg[0]), cliArgCfg);
-		std::cout << "[Warn] No Args Supplied, using default args" << std::endl;
+// Converts rows [firstRow, endRow) to units and pushes them to 'encoder'. Only reads 'pixels' and 'format',
+// so several bands of one image can be encoded at once.
+template<typename Pixels, typename Encoder>
+void encodeRows(const Pixels& pixels, uint32_t firstRow, uint32_t endRow, const UnitFormat& format, Encoder& encoder) {
+	ScratchVector<ARGB> rowBuffer(pixels.width);
+	switch (format.colourFormat) {
+	case CompressedImageColourFormat::colour555:
+	case CompressedImageColourFormat::colour565: {
+		bool is565 = format.colourFormat == CompressedImageColourFormat::colour565;
+		ScratchVector<uint16_t> units(pixels.width);
+		for (uint32_t y = firstRow; y < endRow; y++) {
+			packRow16(pixels, y, is565, rowBuffer.data(), units.data());
+			// Units keep the in-memory (little-endian) byte order of the 16-bit pixel
+			for (uint32_t x = 0; x < pixels.width; x++) { encoder.push((units[x] & 0xff) << 8 | units[x] >> 8); }
+		}
+		break;
+	}
+	case CompressedImageColourFormat::colourFull: {
+		for (uint32_t y = firstRow; y < endRow; y++) {
+			const ARGB* row = rowPixels(pixels, y, rowBuffer.data());
+			for (uint32_t x = 0; x < pixels.width; x++) {
+				// B, G, R - the byte order of a 24bpp pixel in memory
+				encoder.push((row[x] & 0xff) << 16 | (row[x] & 0xff00) | (row[x] >> 16 & 0xff));
+			}
+		}
+		break;
+	}
+	case CompressedImageColourFormat::packedColour3Bit:
+	case CompressedImageColourFormat::packedColour6Bit:
+	case CompressedImageColourFormat::packedGreyscale1Bit:
+	case CompressedImageColourFormat::packedGreyscale2Bit:
+	case CompressedImageColourFormat::packedGreyscale3Bit:
+	case CompressedImageColourFormat::packedGreyscale4Bit: {
+		if (!format.ditheredUnits.empty()) {
+			const uint8_t* units = format.ditheredUnits.data() + static_cast<size_t>(firstRow) * pixels.width;
+			for (size_t i = 0; i < static_cast<size_t>(endRow - firstRow) * pixels.width; i++) { encoder.push(units[i]); }
+			break;
+		}
+		ScratchVector<uint8_t> units(pixels.width);
+		for (uint32_t y = firstRow; y < endRow; y++) {
+			const ARGB* row = rowPixels(pixels, y, rowBuffer.data());
+			quantiseLowBitRow(format, row, pixels.width, y, units.data());
+			for (uint32_t x = 0; x < pixels.width; x++) { encoder.push(units[x]); }
+		}
+		break;
+	}
+	case CompressedImageColourFormat::packedIndexBit:
+	case CompressedImageColourFormat::packedIndex2Bit:
+	case CompressedImageColourFormat::packedIndex4Bit:
+	case CompressedImageColourFormat::index8Bit: {
+		const PaletteIndexMap& paletteLUT = *format.paletteLUT;
+		if (format.exactPalette) {
+			ScratchVector<uint8_t> indices(pixels.width);
+			for (uint32_t y = firstRow; y < endRow; y++) {
+				paletteLUT.indexRow(rowPixels(pixels, y, rowBuffer.data()), pixels.width, indices.data());
+				for (uint32_t x = 0; x < pixels.width; x++) { encoder.push(indices[x]); }
+			}
+			break;
+		}
+		// Neighbouring pixels are usually the same colour, so remember the last match.
+		// Colours that are in the palette skip the nearest-colour search.
+		ARGB lastColour = 0;
+		size_t lastIndex = format.palette.empty() ? 0 : nearestPaletteIndex(format.palette, lastColour);
+		for (uint32_t y = firstRow; y < endRow; y++) {
+			const ARGB* row = rowPixels(pixels, y, rowBuffer.data());
+			for (uint32_t x = 0; x < pixels.width; x++) {
+				if (row[x] != lastColour) {
+					lastColour = row[x];
+					uint32_t exactIndex;
+					lastIndex = paletteLUT.find(lastColour, exactIndex) ? exactIndex : nearestPaletteIndex(format.palette, lastColour);
+				}
+				encoder.push(static_cast<uint32_t>(lastIndex));
+			}
+		}
+		break;
+	}
+	}
+}
+
+// Below this many pixels the threads cost more than they save
+constexpr uint64_t parallelEncodeMinPixels = uint64_t(1) << 18;
+
+// Collects units instead of encoding them, so rows can be coded more than once
+struct UnitCollector {
+	ScratchVector<uint32_t>& units;
+	void push(uint32_t unit) { units.push_back(unit); }
+};
+
+// Run-length encodes rows of units against each predictor in turn and appends the smallest result, after a byte
+// naming its predictor. Returns the predictor.
+RowPredictor encodePredictedRows(const ScratchVector<uint32_t>& units, uint32_t width, const UnitChannels& channels, int unitLength, int packLength, RunCoding runCoding, bitvector& output) {
+	size_t rows = width == 0 ? 0 : units.size() / width;
+	ScratchVector<uint32_t> residuals(width);
+	bitvector best;
+	RowPredictor bestPredictor = RowPredictor::none;
+	for (uint8_t i = 0; i < rowPredictorCount; i++) {
+		RowPredictor predictor = static_cast<RowPredictor>(i);
+		bitvector trial;
+		{
+			RunLengthEncoder encoder = RunLengthEncoder(trial, unitLength, packLength, runCoding);
+			for (size_t y = 0; y < rows; y++) {
+				const uint32_t* row = units.data() + y * width;
+				predictRow(predictor, channels, y == 0 ? nullptr : row - width, row, residuals.data(), width);
+				for (uint32_t x = 0; x < width; x++) { encoder.push(residuals[x]); }
+			}
+		}
+		if (i == 0 || trial.size() < best.size()) {
+			best = std::move(trial);
+			bestPredictor = predictor;
+		}
+	}
+	output.push_many_back(static_cast<uint8_t>(bestPredictor), 8);
+	std::span<const uint8_t> bytes = best.dump();
+	output.push_bytes(bytes.data(), bytes.size());
+	return bestPredictor;
+}
+
+// Encodes rows [firstRow, endRow) as one stripe into 'stripe' and, with entropyCoding, rANS codes its bytes into
+// 'block'. Returns the row predictor it used.
+template<typename Pixels>
+RowPredictor encodeStripe(const Pixels& pixels, const UnitFormat& format, const UnitChannels& channels, uint32_t firstRow, uint32_t endRow, int unitLength, int packLength, RunCoding runCoding, bool predictRows, bool entropyCoding, bitvector& stripe, std::vector<uint8_t>& block) {
+	RowPredictor predictor = RowPredictor::none;
+	if (predictRows) {
+		ScratchVector<uint32_t> units;
+		units.reserve(static_cast<size_t>(pixels.width) * (endRow - firstRow));
+		UnitCollector collector{ units };
+		encodeRows(pixels, firstRow, endRow, format, collector);
+		predictor = encodePredictedRows(units, pixels.width, channels, unitLength, packLength, runCoding, stripe);
 	}
 	else {
-		//Parse and check args
-		cliArgs = parseArgs(argc, argv, sizeof(cliArgCfg) / sizeof(cliArgCfg[0]), cliArgCfg);
-		std::cout << "[Info] Supplied Arguments: " << std::endl;
+		RunLengthEncoder encoder = RunLengthEncoder(stripe, unitLength, packLength, runCoding);
+		encodeRows(pixels, firstRow, endRow, format, encoder);
 	}
-	
-	for (std::pair<std::string, CLIArg> arg : cliArgs) { std::cout << cliargtoa(arg.second); }
-	std::cout << std::endl;
-	if (cliArgs.size() == 0) {
-		std::cerr << "[Error] No Arguments. Terminating." << std::endl; return 1;
+	if (entropyCoding) {
+		std::span<const uint8_t> bytes = stripe.dump();
+		ransEncode(bytes.data(), bytes.size(), block);
 	}
+	return predictor;
+}
 
-	//Initialise Windows GDI+
-	ULONG_PTR gdiplusToken;
-	gdip::GdiplusStartupInput gdiplusStartupInput;
-	gdip::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, nullptr);
+// Appends a version 2 stripe table and stripes: each stripe of stripeHeight rows is run-length encoded on its own,
+// on the pool when the image is large enough, and padded to a whole byte. With predictRows each stripe is coded
+// against whichever row predictor suits it best. With entropyCoding each stripe's bytes are then rANS coded with
+// their own frequency table, giving a version 3 file. Returns how many stripes used each predictor.
+template<typename Pixels>
+std::array<uint32_t, rowPredictorCount> encodeStripes(const Pixels& pixels, const UnitFormat& format, WorkStealingPool* pool, int unitLength, int packLength, RunCoding runCoding, uint32_t stripeHeight, bool predictRows, bool entropyCoding, bitvector& output) {
+	uint32_t stripeCount = std::max<uint32_t>((pixels.height + stripeHeight - 1) / stripeHeight, 1);
+	std::vector<bitvector> stripes(stripeCount);
+	std::vector<std::vector<uint8_t>> blocks(stripeCount);	// left empty without entropyCoding
+	std::vector<RowPredictor> predictors(stripeCount, RowPredictor::none);
+	UnitChannels channels = unitChannels(format.colourFormat, unitLength);
+	auto encodeStripeAt = [&](size_t stripe) {
+		uint32_t firstRow = static_cast<uint32_t>(stripe) * stripeHeight;
+		uint32_t endRow = std::min<uint32_t>(firstRow + stripeHeight, pixels.height);
+		predictors[stripe] = encodeStripe(pixels, format, channels, firstRow, endRow, unitLength, packLength, runCoding, predictRows, entropyCoding, stripes[stripe], blocks[stripe]);
+	};
+	auto stripeBytes = [&](uint32_t stripe) {
+		return entropyCoding ? std::span<const uint8_t>(blocks[stripe]) : stripes[stripe].dump();
+	};
+	uint64_t pixelCount = static_cast<uint64_t>(pixels.width) * pixels.height;
+	if (pool == nullptr || pool->size() < 2 || pixelCount < parallelEncodeMinPixels) {
+		for (uint32_t stripe = 0; stripe < stripeCount; stripe++) { encodeStripeAt(stripe); }
+	}
+	else { pool->parallelFor(stripeCount, encodeStripeAt); }
 
-	// Load the bitmap from a file
-	CLIArg fileSource = cliArgs.at("--source");
-	std::string narrowFileSourcePath;
-	if (!getFromVariantOptional(fileSource.value, &narrowFileSourcePath)) {
-		std::cerr << "[Error] Failed to load bitmap." << std::endl;
+	// Offsets are little-endian, from the end of the table
+	uint32_t offset = 0;
+	for (uint32_t stripe = 0; stripe <= stripeCount; stripe++) {
+		for (int byte = 0; byte < 4; byte++) { output.push_many_back(offset >> (8 * byte) & 0xff, 8); }
+		if (stripe < stripeCount) { offset += static_cast<uint32_t>(stripeBytes(stripe).size()); }
+	}
+	for (uint32_t stripe = 0; stripe < stripeCount; stripe++) {
+		std::span<const uint8_t> bytes = stripeBytes(stripe);
+		output.push_bytes(bytes.data(), bytes.size());
+	}
+	std::array<uint32_t, rowPredictorCount> predictorUse{};
+	if (predictRows) {
+		for (RowPredictor predictor : predictors) { predictorUse[static_cast<uint8_t>(predictor)]++; }
+	}
+	return predictorUse;
+}
+
+// Settings shared by every image compressed in one run
+struct CompressOptions {
+	CompressedImageColourFormat colourFormat = CompressedImageColourFormat::colour565;
+	uint8_t packedLength = 0;
+	uint8_t unitLength = 0;
+	uint8_t paletteBitWidth = 0;
+	RunCoding runCoding = RunCoding::fixedWidth;
+	CompressedImagePaletteFormat paletteFormat = CompressedImagePaletteFormat::noPalette;
+	PaletteOptions paletteOptions;
+	DitherMethod dither = DitherMethod::none;	// for the direct low-bit formats
+	uint8_t runTolerance = 0;	// for the direct low-bit formats, see keepRuns
+	bool runReport = false;	// print size and PSNR against runTolerance
+	int width = 0;	// 0 keeps the source's width
+	int height = 0;	// 0 keeps the source's height
+	uint16_t stripeHeight = 0;	// rows per stripe in version 2 and 3 files, 0 writes version 1
+	bool rowPrediction = false;	// code each stripe against its best row predictor
+	bool entropyCoding = false;	// rANS code each stripe, writing version 3
+	bool autoFormat = false;	// pick the colour format per image
+	int minPSNR = 0;	// lowest PSNR (dB) the auto format accepts from lossy formats, 0 allows lossless ones only
+	bool verbose = true;	// per-image [Info] messages
+};
+
+// Encodes the image into 'output'. Large images are split into bands of rows that are converted and run-length
+// encoded on the pool, then stitched back together in order; the codes are identical to a serial encode.
+// A non-zero options.stripeHeight writes version 2 (or, with entropyCoding, version 3) stripes instead of one
+// stream, optionally row predicted. Direct low-bit formats are dithered as options.dither asks and keep runs within
+// options.runTolerance. Indexed formats count the image's colours into 'colours' unless they are already there.
+template<typename Pixels>
+void encodePixels(Pixels& pixels, const CompressOptions& options, std::optional<ImageColours>& colours, WorkStealingPool* pool, bitvector& output, bitvector& outputPalette) {
+	if (options.paletteBitWidth > 0 && !colours) { colours.emplace(countImageColours(pixels, options.paletteOptions)); }
+	UnitFormat format = prepareUnitFormat(colours ? &*colours : nullptr, options.colourFormat, options.paletteBitWidth, options.paletteFormat, options.paletteOptions.quantiser, options.verbose, outputPalette);
+	prepareLowBitQuantisation(pixels, options.dither, options.runTolerance, pool, false, options.verbose, format);
+
+	auto encodeStart = std::chrono::steady_clock::now();
+	uint64_t pixelCount = static_cast<uint64_t>(pixels.width) * pixels.height;
+	if (options.stripeHeight > 0) {
+		std::array<uint32_t, rowPredictorCount> predictorUse = encodeStripes(pixels, format, pool, options.unitLength, options.packedLength, options.runCoding, options.stripeHeight, options.rowPrediction, options.entropyCoding, output);
+		if (options.verbose && options.rowPrediction) {
+			std::cout << "[Info] Row predictors: none " << predictorUse[0] << ", left " << predictorUse[1] << ", up " << predictorUse[2] << ", Paeth " << predictorUse[3] << " stripes" << std::endl;
+		}
+	}
+	else if (pool == nullptr || pool->size() < 2 || pixelCount < parallelEncodeMinPixels) {
+		RunLengthEncoder encoder = RunLengthEncoder(output, options.unitLength, options.packedLength, options.runCoding);
+		encodeRows(pixels, 0, pixels.height, format, encoder);
+	}
+	else {
+		// Several bands per thread, so threads that finish early can steal the rest
+		uint32_t bandCount = static_cast<uint32_t>(std::min<uint64_t>(pixels.height, pool->size() * 4));
+		std::vector<std::unique_ptr<RunLengthBandEncoder>> bands;
+		for (uint32_t i = 0; i < bandCount; i++) { bands.push_back(std::make_unique<RunLengthBandEncoder>(options.unitLength, options.packedLength, options.runCoding)); }
+		pool->parallelFor(bandCount, [&](size_t band) {
+			uint32_t firstRow = static_cast<uint32_t>(static_cast<uint64_t>(pixels.height) * band / bandCount);
+			uint32_t endRow = static_cast<uint32_t>(static_cast<uint64_t>(pixels.height) * (band + 1) / bandCount);
+			encodeRows(pixels, firstRow, endRow, format, *bands[band]);
+			bands[band]->finish();
+		});
+		RunLengthEncoder encoder = RunLengthEncoder(output, options.unitLength, options.packedLength, options.runCoding);
+		for (const auto& band : bands) { band->appendTo(encoder); }
+	}
+	std::chrono::duration<double, std::milli> encodeTime = std::chrono::steady_clock::now() - encodeStart;
+	if (options.verbose) { std::cout << "[Info] Encoded " << pixels.height << " rows in " << encodeTime.count() << "ms" << std::endl; }
+}
+
+// Decodes the file a row at a time and writes each row straight to the bitmap, so neither is held in memory
+int decompressFileStreaming(const MappedFile& inputFile, const std::string& destinationPath) {
+	CompressedImage header;
+	if (!readCompressedImageHeader(inputFile.data(), inputFile.size(), header)) {
+		std::cerr << "[Error] Failed to decode compressed image." << std::endl;
 		return 1;
 	}
+	// The bitmap is opened with the first row, so a file that cannot be decoded at all leaves nothing behind
+	BMPRowWriter output;
+	bool opened = false;
+	bool openFailed = false;
+	auto decodeStart = std::chrono::steady_clock::now();
+	bool decoded = decodeRLEIRowByRow(inputFile.data(), inputFile.size(), [&](uint32_t y, const ARGB* row) {
+		if (!opened) {
+			opened = output.open(destinationPath, header.width, header.height, 32);
+			openFailed = !opened;
+			if (openFailed) { return false; }
+		}
+		output.writeRow(y, row);
+		return true;
+	});
+	std::chrono::duration<double, std::milli> decodeTime = std::chrono::steady_clock::now() - decodeStart;
+	if (openFailed) { return 1; }
+	if (!opened) {
+		if (!decoded) {
+			std::cerr << "[Error] Failed to decode compressed image." << std::endl;
+			return 1;
+		}
+		if (!output.open(destinationPath, header.width, header.height, 32)) { return 1; }
+	}
+	if (!output.close()) { return 1; }
+	if (!decoded) {
+		// The rows are already written, so the bitmap is kept with the damaged stripes black
+		std::cerr << "[Error] Kept " << destinationPath << " with the damaged stripes black" << std::endl;
+		return 1;
+	}
+	std::cout << "[Info] Decoded " << header.width << "x" << header.height << " image row by row in " << decodeTime.count() << "ms" << std::endl;
+	return 0;
+}
 
-	std::wstring wideFileSourcePath = to_wide(narrowFileSourcePath);
-	gdip::Bitmap* bitmap = new Gdiplus::Bitmap(wideFileSourcePath.c_str());
-	if (bitmap->GetLastStatus() != Gdiplus::Ok)
-	{
-		std::cerr << "[Error] Failed to load bitmap." << std::endl;
+// Stripes of version 2 files are decoded on 'threads' threads
+int decompressFile(std::unordered_map<std::string, CLIArg>& cliArgs, int threads) {
+	std::string sourcePath;
+	std::string destinationPath;
+	if (!cliArgs.contains("--source") || !getFromVariantOptional(cliArgs.at("--source").value, &sourcePath)) {
+		std::cerr << "[Error] File Path Required: --source (-s)" << std::endl;
+		return 1;
+	}
+	if (!cliArgs.contains("--destination") || !getFromVariantOptional(cliArgs.at("--destination").value, &destinationPath)) {
+		std::cerr << "[Error] File Path Required: --destination (-d)" << std::endl;
+		return 1;
+	}
+
+	// The header and streams are decoded straight from the mapping
+	MappedFile inputFile;
+	if (!inputFile.open(sourcePath)) {
+		std::cerr << "[Error] Failed to open compressed image." << std::endl;
 		return 1;
 	}
 
-	//Flip image if necessary
-	gdip::BitmapData bitmapData;
-	gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-	bitmap->LockBits(&rect, gdip::ImageLockModeRead | gdip::ImageLockModeWrite, PixelFormat32bppARGB, &bitmapData);
+	if (cliArgs.contains("--stream")) { return decompressFileStreaming(inputFile, destinationPath); }
 
-	//calculate size of bitmapData
-	size_t contentSize = bitmapData.Height * abs(bitmapData.Stride);
-	uint8_t* contentBuf = static_cast<uint8_t*>(malloc(contentSize));
-	uint8_t* startPoint = bitmapData.Stride < 0 ? contentBuf + contentSize : contentBuf;
-	for (int i = 0; i < bitmapData.Height; i++) {
-		uint8_t* srcRow = static_cast<uint8_t*>(bitmapData.Scan0) + i * bitmapData.Stride;
-		uint8_t* dstRow = startPoint + (bitmapData.Stride * i);
-		memcpy(dstRow, srcRow, bitmapData.Stride);
+	std::unique_ptr<WorkStealingPool> pool;
+	if (threads != 1) { pool = std::make_unique<WorkStealingPool>(threads); }
+	DecodedImage image;
+	auto decodeStart = std::chrono::steady_clock::now();
+	if (!decodeRLEI(inputFile.data(), inputFile.size(), image, pool.get())) {
+		std::cerr << "[Error] Failed to decode compressed image." << std::endl;
+		return 1;
 	}
+	std::chrono::duration<double, std::milli> decodeTime = std::chrono::steady_clock::now() - decodeStart;
+	std::cout << "[Info] Decoded " << image.width << "x" << image.height << " image in " << decodeTime.count() << "ms" << std::endl;
 
-	memcpy(bitmapData.Scan0, contentBuf, contentSize);
-	free(contentBuf);
-	bitmapData.Stride = abs(bitmapData.Stride);
+	return writeBMP(destinationPath, image, 32) ? 0 : 1;
+}
 
-	bitmap->UnlockBits(&bitmapData);
+// Names accepted by --colour-format, and the candidates the auto format tries
+struct ColourFormatChoice {
+	const char* name;
+	CompressedImageColourFormat colourFormat;
+	uint8_t packedLength;
+	uint8_t unitLength;
+	uint8_t paletteBitWidth;
+	RunCoding runCoding = RunCoding::fixedWidth;
+};
+constexpr ColourFormatChoice colourFormatChoices[] = {
+	{ "pi1", CompressedImageColourFormat::packedIndexBit, 8, 1, 1 },
+	{ "pi2", CompressedImageColourFormat::packedIndex2Bit, 8, 2, 2 },
+	{ "pi4", CompressedImageColourFormat::packedIndex4Bit, 8, 4, 4 },
+	{ "i8r1", CompressedImageColourFormat::index8Bit, 16, 8, 8 },
+	{ "i8r2", CompressedImageColourFormat::index8Bit, 24, 8, 8 },
+	{ "pg1", CompressedImageColourFormat::packedGreyscale1Bit, 8, 1, 0 },
+	{ "pg2", CompressedImageColourFormat::packedGreyscale2Bit, 8, 2, 0 },
+	{ "pc3", CompressedImageColourFormat::packedColour3Bit, 8, 3, 0 },
+	{ "pg3", CompressedImageColourFormat::packedGreyscale3Bit, 8, 3, 0 },
+	{ "pg4", CompressedImageColourFormat::packedGreyscale4Bit, 8, 4, 0 },
+	{ "pc6", CompressedImageColourFormat::packedColour6Bit, 8, 6, 0 },
+	{ "c555r1", CompressedImageColourFormat::colour555, 24, 16, 0 },
+	{ "c555r2", CompressedImageColourFormat::colour555, 32, 16, 0 },
+	{ "c565r1", CompressedImageColourFormat::colour565, 24, 16, 0 },
+	{ "c565r2", CompressedImageColourFormat::colour565, 32, 16, 0 },
+	{ "c24r1", CompressedImageColourFormat::colourFull, 32, 24, 0 },
+	{ "c24r2", CompressedImageColourFormat::colourFull, 40, 24, 0 },
+	// Exp-Golomb runs; the packed length is just the shortest code
+	{ "pi1e", CompressedImageColourFormat::packedIndexBit, 2, 1, 1, RunCoding::expGolomb },
+	{ "pi2e", CompressedImageColourFormat::packedIndex2Bit, 3, 2, 2, RunCoding::expGolomb },
+	{ "pi4e", CompressedImageColourFormat::packedIndex4Bit, 5, 4, 4, RunCoding::expGolomb },
+	{ "i8e", CompressedImageColourFormat::index8Bit, 9, 8, 8, RunCoding::expGolomb },
+	{ "pg1e", CompressedImageColourFormat::packedGreyscale1Bit, 2, 1, 0, RunCoding::expGolomb },
+	{ "pg2e", CompressedImageColourFormat::packedGreyscale2Bit, 3, 2, 0, RunCoding::expGolomb },
+	{ "pc3e", CompressedImageColourFormat::packedColour3Bit, 4, 3, 0, RunCoding::expGolomb },
+	{ "pg3e", CompressedImageColourFormat::packedGreyscale3Bit, 4, 3, 0, RunCoding::expGolomb },
+	{ "pg4e", CompressedImageColourFormat::packedGreyscale4Bit, 5, 4, 0, RunCoding::expGolomb },
+	{ "pc6e", CompressedImageColourFormat::packedColour6Bit, 7, 6, 0, RunCoding::expGolomb },
+	{ "c555e", CompressedImageColourFormat::colour555, 17, 16, 0, RunCoding::expGolomb },
+	{ "c565e", CompressedImageColourFormat::colour565, 17, 16, 0, RunCoding::expGolomb },
+	{ "c24e", CompressedImageColourFormat::colourFull, 25, 24, 0, RunCoding::expGolomb },
+};
 
-	//Resize image if necessary
-	int widthDesired = bitmap->GetWidth(), heightDesired = bitmap->GetHeight(), resize = 0;
+// Stripe height used by --predict and --entropy when --stripe-rows is not given. Each stripe carries its own
+// predictor and frequency table, so stripes much shorter than this spend a noticeable share of their bytes on them.
+constexpr uint16_t defaultStripeRows = 256;
+
+void applyColourFormat(CompressOptions& options, const ColourFormatChoice& choice) {
+	options.colourFormat = choice.colourFormat;
+	options.packedLength = choice.packedLength;
+	options.unitLength = choice.unitLength;
+	options.paletteBitWidth = choice.paletteBitWidth;
+	options.runCoding = choice.runCoding;
+}
+
+// Output streams and scratch memory kept between images, so a batch reuses their storage instead of
+// reallocating it per file
+struct CompressBuffers {
+	bitvector data;
+	bitvector palette;
+	Arena arena;	// histogram, palette lookup and row buffers; reset at the start of every image
+};
+
+struct CompressStats {
+	uint64_t sourceBytes = 0;
+	uint64_t outputBytes = 0;
+};
+
+bool parseCompressOptions(std::unordered_map<std::string, CLIArg>& cliArgs, CompressOptions& options) {
 	if (cliArgs.contains("--width")) {
-		if (!getFromVariantOptional(cliArgs.at("--width").value, &widthDesired)) {
+		if (!getFromVariantOptional(cliArgs.at("--width").value, &options.width) || options.width <= 0) {
 			std::cerr << "[Error] Misformatted Argument: --width (-w)" << std::endl << "	Expected: Positive Integer" << std::endl;
-			return 1;
+			return false;
 		}
-		resize |= 0b01;
 	}
 	if (cliArgs.contains("--height")) {
-		if (!getFromVariantOptional(cliArgs.at("--height").value, &heightDesired)) {
+		if (!getFromVariantOptional(cliArgs.at("--height").value, &options.height) || options.height <= 0) {
 			std::cerr << "[Error] Misformatted Argument: --height (-h)" << std::endl << "	Expected: Positive Integer" << std::endl;
-			return 1;
+			return false;
 		}
-		resize |= 0b10;
-	}
-	if (resize > 0) {
-		gdip::Bitmap* workBitmap = new gdip::Bitmap(widthDesired, heightDesired);
-		gdip::Graphics g(workBitmap);
-		float horizontalScalingFactor = (float)widthDesired / (float)bitmap->GetWidth();
-		float verticalScalingFactor = (float)heightDesired / (float)bitmap->GetHeight();
-		g.ScaleTransform(horizontalScalingFactor, verticalScalingFactor);
-		g.DrawImage(bitmap, 0, 0);
-		delete bitmap;
-		bitmap = workBitmap;
-		std::cout << "[Info] New Dimensions: W:" << bitmap->GetHeight() << " H:" << bitmap->GetWidth() << std::endl;
 	}
 
 	CLIArg colourFormat = cliArgs.at("--colour-format");
 	std::string colourFormatString;
-	uint8_t packedLength = 0;
-	uint8_t unitLength = 0;
-	uint8_t paletteBitWidth = 0;
 	if (!getFromVariantOptional(colourFormat.value, &colourFormatString)) {
 		std::cerr << "[Error] Invalid Colour Format" << std::endl;
-		return 1;
+		return false;
+	}
+	auto choice = std::find_if(std::begin(colourFormatChoices), std::end(colourFormatChoices), [&](const ColourFormatChoice& c) { return colourFormatString == c.name; });
+	if (choice != std::end(colourFormatChoices)) { applyColourFormat(options, *choice); }
+	else if (colourFormatString == "auto") {
+		// Chosen per image; these are placeholders until then
+		options.autoFormat = true;
+		options.colourFormat = CompressedImageColourFormat::colour565; options.packedLength = 24; options.unitLength = 16; options.paletteBitWidth = 0;
 	}
-	CompressedImageColourFormat colourFormatDesired;
-	if (colourFormatString == "pi1") { colourFormatDesired = CompressedImageColourFormat::packedIndexBit; packedLength = 8; unitLength = 1;  paletteBitWidth = 1; }
-	else if (colourFormatString == "pi2") { colourFormatDesired = CompressedImageColourFormat::packedIndex2Bit; packedLength = 8; unitLength = 2;  paletteBitWidth = 2; }
-	else if (colourFormatString == "pi4") { colourFormatDesired = CompressedImageColourFormat::packedIndex4Bit; packedLength = 8; unitLength = 4;  paletteBitWidth = 4; }
-	else if (colourFormatString == "i8r1") { colourFormatDesired = CompressedImageColourFormat::index8Bit; packedLength = 16; unitLength = 8;  paletteBitWidth = 8; }
-	else if (colourFormatString == "i8r2") { colourFormatDesired = CompressedImageColourFormat::index8Bit; packedLength = 24; unitLength = 8;  paletteBitWidth = 8; }
-	else if (colourFormatString == "pg1") { colourFormatDesired = CompressedImageColourFormat::packedGreyscale1Bit; packedLength = 8; unitLength = 1; paletteBitWidth = 0; }
-	else if (colourFormatString == "pg2") { colourFormatDesired = CompressedImageColourFormat::packedGreyscale2Bit; packedLength = 8; unitLength = 2; paletteBitWidth = 0; }
-	else if (colourFormatString == "pc3") { colourFormatDesired = CompressedImageColourFormat::packedColour3Bit; packedLength = 8; unitLength = 3;  paletteBitWidth = 0; }
-	else if (colourFormatString == "pg3") { colourFormatDesired = CompressedImageColourFormat::packedGreyscale3Bit; packedLength = 8; unitLength = 3; paletteBitWidth = 0; }
-	else if (colourFormatString == "pg4") { colourFormatDesired = CompressedImageColourFormat::packedGreyscale4Bit; packedLength = 8; unitLength = 4; paletteBitWidth = 0; }
-	else if (colourFormatString == "pc6") { colourFormatDesired = CompressedImageColourFormat::packedColour6Bit; packedLength = 8; unitLength = 6;  paletteBitWidth = 0; }
-	else if (colourFormatString == "c555r1") { colourFormatDesired = CompressedImageColourFormat::colour555; packedLength = 24; unitLength = 16;  paletteBitWidth = 0; }
-	else if (colourFormatString == "c555r2") { colourFormatDesired = CompressedImageColourFormat::colour555; packedLength = 32; unitLength = 16;  paletteBitWidth = 0; }
-	else if (colourFormatString == "c565r1") { colourFormatDesired = CompressedImageColourFormat::colour565; packedLength = 24; unitLength = 16;  paletteBitWidth = 0; }
-	else if (colourFormatString == "c565r2") { colourFormatDesired = CompressedImageColourFormat::colour565; packedLength = 32; unitLength = 16;  paletteBitWidth = 0; }
-	else if (colourFormatString == "c24r1") { colourFormatDesired = CompressedImageColourFormat::colourFull; packedLength = 32; unitLength = 24;  paletteBitWidth = 0; }
-	else if (colourFormatString == "c24r2") { colourFormatDesired = CompressedImageColourFormat::colourFull; packedLength = 40; unitLength = 24;  paletteBitWidth = 0; }
 	else {
-		colourFormatDesired = CompressedImageColourFormat::colour565;
+		options.colourFormat = CompressedImageColourFormat::colour565; options.packedLength = 24; options.unitLength = 16; options.paletteBitWidth = 0;
 		std::cout << "[Info] No colour format supplied, using 16-bit 565 colour, with a run-length of 1" << std::endl;
 	}
 
-	bitvector rawDataStream;
-	bitvector rledDataStream;
-
 	CLIArg paletteFormatArg;
-	CompressedImagePaletteFormat paletteFormatDesired;
 	if (cliArgs.contains("--palette-format")) {
 		paletteFormatArg = cliArgs.at("--palette-format");
 		std::string paletteFormatString;
 		if (!getFromVariantOptional(paletteFormatArg.value, &paletteFormatString)) {
 			std::cerr << "[Error] Invalid Colour Format" << std::endl;
-			return 1;
+			return false;
 		}
-		if (paletteFormatString == "g2") { paletteFormatDesired = CompressedImagePaletteFormat::greyscale2Bit; }
-		else if (paletteFormatString == "g3") { paletteFormatDesired = CompressedImagePaletteFormat::greyscale3Bit; }
-		else if (paletteFormatString == "g4") { paletteFormatDesired = CompressedImagePaletteFormat::greyscale4Bit; }
-		else if (paletteFormatString == "c3") { paletteFormatDesired = CompressedImagePaletteFormat::colour3Bit; }
-		else if (paletteFormatString == "c6") { paletteFormatDesired = CompressedImagePaletteFormat::colour6Bit; }
-		else if (paletteFormatString == "c555") { paletteFormatDesired = CompressedImagePaletteFormat::colour555; }
-		else if (paletteFormatString == "c565") { paletteFormatDesired = CompressedImagePaletteFormat::colour565; }
-		else if (paletteFormatString == "c24") { paletteFormatDesired = CompressedImagePaletteFormat::colourFull; }
+		if (paletteFormatString == "g2") { options.paletteFormat = CompressedImagePaletteFormat::greyscale2Bit; }
+		else if (paletteFormatString == "g3") { options.paletteFormat = CompressedImagePaletteFormat::greyscale3Bit; }
+		else if (paletteFormatString == "g4") { options.paletteFormat = CompressedImagePaletteFormat::greyscale4Bit; }
+		else if (paletteFormatString == "c3") { options.paletteFormat = CompressedImagePaletteFormat::colour3Bit; }
+		else if (paletteFormatString == "c6") { options.paletteFormat = CompressedImagePaletteFormat::colour6Bit; }
+		else if (paletteFormatString == "c555") { options.paletteFormat = CompressedImagePaletteFormat::colour555; }
+		else if (paletteFormatString == "c565") { options.paletteFormat = CompressedImagePaletteFormat::colour565; }
+		else if (paletteFormatString == "c24") { options.paletteFormat = CompressedImagePaletteFormat::colourFull; }
 		else {
-			paletteFormatDesired = CompressedImagePaletteFormat::noPalette;
+			options.paletteFormat = CompressedImagePaletteFormat::noPalette;
 		}
 	}
 	else {
-		paletteFormatDesired = CompressedImagePaletteFormat::noPalette;
-	}
-
-	bitvector outputPalette = bitvector();
-	switch (colourFormatDesired) {
-	case CompressedImageColourFormat::colour555: {
-		bitmap->ConvertFormat(PixelFormat16bppRGB555, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				rsize_t pixel_start_offset = x * 2 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				rawDataStream.push_many_back(pixel_start[0], 8);
-				rawDataStream.push_many_back(pixel_start[1], 8);
-			}
+		options.paletteFormat = CompressedImagePaletteFormat::noPalette;
+	}
+
+	if (cliArgs.contains("--quantiser")) {
+		std::string quantiserString;
+		if (!getFromVariantOptional(cliArgs.at("--quantiser").value, &quantiserString) || !parseQuantiserMethod(quantiserString, options.paletteOptions.quantiser)) {
+			std::cerr << "[Error] Misformatted Argument: --quantiser (-q)" << std::endl << "	Expected: popularity, median-cut or octree" << std::endl;
+			return false;
 		}
-		break;
 	}
-	case CompressedImageColourFormat::colour565: {
-		bitmap->ConvertFormat(PixelFormat16bppRGB565, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 2 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				rawDataStream.push_many_back(pixel_start[0], 8);
-				rawDataStream.push_many_back(pixel_start[1], 8);
-			}
+	if (cliArgs.contains("--dither")) {
+		std::string ditherString;
+		if (!getFromVariantOptional(cliArgs.at("--dither").value, &ditherString) || !parseDitherMethod(ditherString, options.dither)) {
+			std::cerr << "[Error] Misformatted Argument: --dither (-t)" << std::endl << "	Expected: none, ordered or floyd-steinberg" << std::endl;
+			return false;
+		}
+		if (options.dither != DitherMethod::none && !options.autoFormat && !ditherable(options.colourFormat)) {
+			std::cout << "[Warn] --dither only applies to the pc3, pc6 and pg1 to pg4 colour formats" << std::endl;
 		}
-		break;
 	}
-	case CompressedImageColourFormat::colourFull: {
-		bitmap->ConvertFormat(PixelFormat24bppRGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 3 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				rawDataStream.push_many_back(pixel_start[0], 8);
-				rawDataStream.push_many_back(pixel_start[1], 8);
-				rawDataStream.push_many_back(pixel_start[2], 8);
-			}
+	if (cliArgs.contains("--run-tolerance")) {
+		int runTolerance;
+		if (!getFromVariantOptional(cliArgs.at("--run-tolerance").value, &runTolerance) || runTolerance < 0 || runTolerance > 255) {
+			std::cerr << "[Error] Misformatted Argument: --run-tolerance (-k)" << std::endl << "	Expected: Integer from 0 to 255" << std::endl;
+			return false;
+		}
+		options.runTolerance = static_cast<uint8_t>(runTolerance);
+		if (options.runTolerance > 0 && !options.autoFormat && !ditherable(options.colourFormat)) {
+			std::cout << "[Warn] --run-tolerance only applies to the pc3, pc6 and pg1 to pg4 colour formats" << std::endl;
 		}
-		bitmap->UnlockBits(&bitmapData);
-		break;
 	}
-	case CompressedImageColourFormat::packedColour3Bit: {
-		bitmap->ConvertFormat(PixelFormat24bppRGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 3 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				ConvertibleColour::colour3_t colour = ConvertibleColour().fromColour24Bit({pixel_start[0], pixel_start[1], pixel_start[3]})->toColour3Bit();
-				rawDataStream.push_many_back(std::bitset<3>(colour));
-			}
+	options.runReport = cliArgs.contains("--run-report");
+	if (cliArgs.contains("--sample-step")) {
+		int sampleStep;
+		if (!getFromVariantOptional(cliArgs.at("--sample-step").value, &sampleStep) || sampleStep <= 0) {
+			std::cerr << "[Error] Misformatted Argument: --sample-step (-n)" << std::endl << "	Expected: Positive Integer" << std::endl;
+			return false;
 		}
-		break;
+		options.paletteOptions.sampleStep = sampleStep;
 	}
-	case CompressedImageColourFormat::packedColour6Bit: {
-		bitmap->ConvertFormat(PixelFormat24bppRGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		size_t rawSize = bitmapData.PixelFormat == PixelFormat24bppRGB ? 3 : 2;
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 3 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				ConvertibleColour::colour3_t colour = ConvertibleColour().fromColour24Bit({ pixel_start[0], pixel_start[1], pixel_start[3] })->toColour6Bit();
-				rawDataStream.push_many_back(std::bitset<6>(colour));
-			}
+	if (cliArgs.contains("--min-psnr")) {
+		if (!getFromVariantOptional(cliArgs.at("--min-psnr").value, &options.minPSNR) || options.minPSNR <= 0) {
+			std::cerr << "[Error] Misformatted Argument: --min-psnr (-m)" << std::endl << "	Expected: Positive Integer" << std::endl;
+			return false;
 		}
-		break;
+		if (!options.autoFormat) { std::cout << "[Warn] --min-psnr only applies to the auto colour format" << std::endl; }
 	}
-	case CompressedImageColourFormat::packedGreyscale1Bit: {
-		bitmap->ConvertFormat(PixelFormat24bppRGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 3 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				ConvertibleColour::colour3_t colour = ConvertibleColour().fromColour24Bit({ pixel_start[0], pixel_start[1], pixel_start[3] })->toGreyscale1Bit();
-				rawDataStream.push_back(static_cast<bool>(colour));
-			}
+	if (cliArgs.contains("--stripe-rows")) {
+		int stripeRows;
+		if (!getFromVariantOptional(cliArgs.at("--stripe-rows").value, &stripeRows) || stripeRows <= 0 || stripeRows > UINT16_MAX) {
+			std::cerr << "[Error] Misformatted Argument: --stripe-rows (-r)" << std::endl << "	Expected: Integer from 1 to 65535" << std::endl;
+			return false;
 		}
-		break;
+		options.stripeHeight = static_cast<uint16_t>(stripeRows);
 	}
-	case CompressedImageColourFormat::packedGreyscale2Bit: {
-		bitmap->ConvertFormat(PixelFormat24bppRGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 3 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				ConvertibleColour::colour3_t colour = ConvertibleColour().fromColour24Bit({ pixel_start[0], pixel_start[1], pixel_start[3] })->toGreyscale2Bit();
-				rawDataStream.push_many_back(std::bitset<2>(colour));
-			}
+	if (cliArgs.contains("--predict")) {
+		options.rowPrediction = true;
+		if (options.stripeHeight == 0) { options.stripeHeight = defaultStripeRows; }
+	}
+	if (cliArgs.contains("--entropy")) {
+		options.entropyCoding = true;
+		if (options.stripeHeight == 0) { options.stripeHeight = defaultStripeRows; }
+	}
+
+	if (!RunLengthEncoder::validLengths(options.unitLength, options.packedLength)) {
+		std::cerr << "[Error] Invalid Colour Format" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Fills in the header of an image encoded with 'options'
+void fillHeader(const CompressOptions& options, uint32_t width, uint32_t height, const bitvector& palette, size_t dataBytes, CompressedImage& header) {
+	header.identifier[0] = 'R';
+	header.identifier[1] = 'L';
+	header.identifier[2] = 'E';
+	header.identifier[3] = 'I';
+	header.version = options.stripeHeight == 0 ? 1 : options.entropyCoding ? 3 : 2;
+	header.rowPrediction = options.rowPrediction ? 1 : 0;
+	header.imageSize = static_cast<uint32_t>(palette.byte_size() + dataBytes + compressedImageHeaderSize);
+	header.width = static_cast<uint16_t>(width);
+	header.height = static_cast<uint16_t>(height);
+	header.imageDataSizeBytes = static_cast<uint32_t>(dataBytes);
+	header.colourFormat = options.colourFormat;
+	header.packedLength = options.packedLength;
+	header.unitLength = options.unitLength;
+	int paletteEntryBits = paletteEntryBitWidth(options.paletteFormat);
+	header.paletteSize = paletteEntryBits == 0 ? 0 : static_cast<uint8_t>(palette.size() / paletteEntryBits);
+	header.runCoding = options.runCoding;
+	header.paletteSizeBytes = palette.byte_size();
+	header.stripeHeight = options.stripeHeight;
+	header.paletteColourFormat = options.paletteFormat;
+	header.headerChecksum = 0;	// filled in by serialiseCompressedImageHeader
+	header.palette = nullptr;
+	header.imageData = nullptr;
+}
+
+// Copies the rows of 16 evenly spaced bands adding up to about 'targetPixels', or the whole of a smaller image.
+// The auto format's candidates all read this copy instead of going back to the source.
+template<typename Pixels>
+Image sampleRows(const Pixels& pixels, uint64_t targetPixels) {
+	constexpr uint32_t bandCount = 16;
+	std::vector<uint32_t> rows;
+	if (static_cast<uint64_t>(pixels.width) * pixels.height <= targetPixels) {
+		for (uint32_t y = 0; y < pixels.height; y++) { rows.push_back(y); }
+	}
+	else {
+		uint32_t bandRows = std::max<uint32_t>(static_cast<uint32_t>(targetPixels / pixels.width / bandCount), 1);
+		for (uint32_t band = 0; band < bandCount; band++) {
+			uint32_t firstRow = static_cast<uint32_t>(static_cast<uint64_t>(pixels.height) * band / bandCount);
+			for (uint32_t y = firstRow; y < std::min(firstRow + bandRows, pixels.height); y++) { rows.push_back(y); }
 		}
-		break;
 	}
-	case CompressedImageColourFormat::packedGreyscale3Bit: {
-		bitmap->ConvertFormat(PixelFormat24bppRGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 3 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				ConvertibleColour::colour3_t colour = ConvertibleColour().fromColour24Bit({ pixel_start[0], pixel_start[1], pixel_start[3] })->toGreyscale3Bit();
-				rawDataStream.push_many_back(std::bitset<3>(colour));
+	Image sample;
+	sample.width = pixels.width;
+	sample.height = static_cast<uint32_t>(rows.size());
+	sample.pixels.resize(static_cast<size_t>(sample.width) * sample.height);
+	for (uint32_t y = 0; y < sample.height; y++) {
+		// BMPView rows are converted straight into the sample
+		const ARGB* row = rowPixels(pixels, rows[y], sample.row(y));
+		if (row != sample.row(y)) { std::copy(row, row + sample.width, sample.row(y)); }
+	}
+	return sample;
+}
+
+// Pixels the auto format encodes of each image to compare the candidates
+constexpr uint64_t autoFormatSamplePixels = uint64_t(1) << 18;
+
+struct FormatTrial {
+	uint64_t estimatedBytes = 0;
+	double psnr = 0;	// infinity when the sample came back unchanged
+};
+
+// Encodes the sampled rows with one candidate format and decodes them again. The size of the whole file, which
+// is imageHeight rows high, is estimated from the sample's codes, scaled up by the rows that were left out.
+FormatTrial tryColourFormat(const Image& sample, uint32_t imageHeight, const ImageColours& colours, const CompressOptions& options) {
+	FormatTrial trial;
+	bitvector palette, data;
+	UnitFormat format = prepareUnitFormat(&colours, options.colourFormat, options.paletteBitWidth, options.paletteFormat, options.paletteOptions.quantiser, false, palette);
+	// Already running on the pool, so Floyd-Steinberg dithers the sample serially
+	prepareLowBitQuantisation(sample, options.dither, options.runTolerance, nullptr, false, false, format);
+	{
+		RunLengthEncoder encoder = RunLengthEncoder(data, options.unitLength, options.packedLength, options.runCoding);
+		encodeRows(sample, 0, sample.height, format, encoder);
+	}
+	trial.estimatedBytes = compressedImageHeaderSize + palette.byte_size() + data.byte_size() * imageHeight / std::max<uint32_t>(sample.height, 1);
+
+	CompressOptions sampleOptions = options;
+	sampleOptions.stripeHeight = 0;
+	sampleOptions.rowPrediction = false;
+	sampleOptions.entropyCoding = false;
+	CompressedImage header;
+	fillHeader(sampleOptions, sample.width, sample.height, palette, data.byte_size(), header);
+	std::vector<uint8_t> file(compressedImageHeaderSize);
+	serialiseCompressedImageHeader(header, file.data());
+	std::span<const uint8_t> paletteBytes = palette.dump(), dataBytes = data.dump();
+	file.insert(file.end(), paletteBytes.begin(), paletteBytes.end());
+	file.insert(file.end(), dataBytes.begin(), dataBytes.end());
+	DecodedImage decoded;
+	if (!decodeRLEI(file.data(), file.size(), decoded)) { return trial; }
+
+	uint64_t squaredError = 0;
+	for (uint32_t y = 0; y < sample.height; y++) {
+		const ARGB* original = sample.row(y);
+		const ARGB* restored = decoded.row(y);
+		for (uint32_t x = 0; x < sample.width; x++) {
+			for (int shift = 0; shift < 24; shift += 8) {
+				int difference = static_cast<int>((original[x] >> shift) & 0xff) - static_cast<int>((restored[x] >> shift) & 0xff);
+				squaredError += difference * difference;
 			}
 		}
-		break;
 	}
-	case CompressedImageColourFormat::packedGreyscale4Bit: {
-		bitmap->ConvertFormat(PixelFormat24bppRGB, gdip::DitherTypeNone, gdip::PaletteTypeCustom, nullptr, 0);
-		gdip::BitmapData bitmapData;
-		gdip::Rect rect(0, 0, bitmap->GetWidth(), bitmap->GetHeight());
-		bitmap->LockBits(&rect, gdip::ImageLockModeRead, bitmap->GetPixelFormat(), &bitmapData);
-		for (int y = 0; y < bitmapData.Height; y++) {
-			for (int x = 0; x < bitmapData.Width; x++) {
-				size_t pixel_start_offset = x * 3 + y * bitmapData.Stride;
-				uint8_t* pixel_start = static_cast<uint8_t*>(bitmapData.Scan0) + pixel_start_offset;
-				ConvertibleColour::colour3_t colour = ConvertibleColour().fromColour24Bit({ pixel_start[0], pixel_start[1], pixel_start[3] })->toGreyscale4Bit();
-				rawDataStream.push_many_back(std::bitset<4>(colour));
-			}
+	uint64_t samples = static_cast<uint64_t>(sample.width) * sample.height * 3;
+	trial.psnr = squaredError == 0 ? std::numeric_limits<double>::infinity() : 10.0 * std::log10(255.0 * 255.0 * samples / squaredError);
+	return trial;
+}
+
+// Tries every colour format on a sample of the image, on the pool when there is one, and keeps the one with the
+// smallest estimated file that is lossless or, with a minimum PSNR set, scores at least that. The image's colours
+// are counted into 'colours' once, for every indexed candidate and then the final encode.
+template<typename Pixels>
+void selectColourFormat(Pixels& pixels, CompressOptions& options, WorkStealingPool* pool, std::optional<ImageColours>& colours) {
+	Image sample = sampleRows(pixels, autoFormatSamplePixels);
+	if (!colours) { colours.emplace(countImageColours(pixels, options.paletteOptions)); }
+	// Indexed candidates need somewhere to put their palette
+	CompressedImagePaletteFormat paletteFormat = options.paletteFormat == CompressedImagePaletteFormat::noPalette ? CompressedImagePaletteFormat::colourFull : options.paletteFormat;
+
+	constexpr size_t candidateCount = std::size(colourFormatChoices);
+	FormatTrial trials[candidateCount];
+	auto runTrial = [&](size_t i) {
+		CompressOptions candidate = options;
+		applyColourFormat(candidate, colourFormatChoices[i]);
+		if (candidate.paletteBitWidth > 0) { candidate.paletteFormat = paletteFormat; }
+		trials[i] = tryColourFormat(sample, pixels.height, *colours, candidate);
+	};
+	if (pool != nullptr && pool->size() > 1) { pool->parallelFor(candidateCount, runTrial); }
+	else {
+		for (size_t i = 0; i < candidateCount; i++) { runTrial(i); }
+	}
+
+	double requiredPSNR = options.minPSNR > 0 ? options.minPSNR : std::numeric_limits<double>::infinity();
+	size_t best = candidateCount;
+	for (size_t i = 0; i < candidateCount; i++) {
+		if (trials[i].psnr < requiredPSNR) { continue; }
+		if (best == candidateCount || trials[i].estimatedBytes < trials[best].estimatedBytes) { best = i; }
+	}
+	// Nothing good enough: settle for the most faithful
+	if (best == candidateCount) {
+		best = 0;
+		for (size_t i = 1; i < candidateCount; i++) {
+			if (trials[i].psnr > trials[best].psnr) { best = i; }
 		}
-		break;
 	}
-	case CompressedImageColourFormat::packedIndexBit: {
-		std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> extractedPalette = makeSmallOptimalPalette(1 << static_cast<uint32_t>(paletteBitWidth), *bitmap, false);
-		std::set<gdip::ARGB> imgPaletteLUT = getImageColours(bitmap);
-		std::set<gdip::ARGB> outPaletteLUT = makePaletteLUT(extractedPalette.get());
 
-		struct indexedImage resultImage;
+	applyColourFormat(options, colourFormatChoices[best]);
+	if (options.paletteBitWidth > 0) { options.paletteFormat = paletteFormat; }
+	if (!options.verbose) { return; }
+	std::cout << "[Info] Auto format, from " << sample.height << " of " << pixels.height << " rows:" << std::endl;
+	for (size_t i = 0; i < candidateCount; i++) {
+		std::cout << "	" << colourFormatChoices[i].name << ": ~" << trials[i].estimatedBytes << " bytes, PSNR ";
+		if (std::isinf(trials[i].psnr)) { std::cout << "lossless"; }
+		else { std::cout << trials[i].psnr << "dB"; }
+		std::cout << (i == best ? " <- chosen" : "") << std::endl;
+	}
+}
+
+// Run tolerances the run report always tries, besides the one asked for. Below half a level step (128 for the
+// 1-bit formats, 43 for pc6) a tolerance only matters with ordered dithering.
+constexpr uint8_t reportedRunTolerances[] = { 0, 16, 32, 48, 64, 96, 128, 160, 192, 224 };
+
+// Prints the estimated size and PSNR of the chosen format at a range of run tolerances, from the same sample of
+// rows the auto format uses, so a tolerance can be picked that still looks acceptable
+template<typename Pixels>
+void reportRunTolerances(Pixels& pixels, const CompressOptions& options, WorkStealingPool* pool) {
+	if (!ditherable(options.colourFormat)) {
+		std::cout << "[Warn] --run-report only applies to the pc3, pc6 and pg1 to pg4 colour formats" << std::endl;
+		return;
+	}
+	std::vector<uint8_t> tolerances(std::begin(reportedRunTolerances), std::end(reportedRunTolerances));
+	if (std::find(tolerances.begin(), tolerances.end(), options.runTolerance) == tolerances.end()) {
+		tolerances.insert(std::upper_bound(tolerances.begin(), tolerances.end(), options.runTolerance), options.runTolerance);
+	}
+	Image sample = sampleRows(pixels, autoFormatSamplePixels);
+	// The direct formats have no palette to build
+	ImageColours noColours;
+	std::vector<FormatTrial> trials(tolerances.size());
+	auto runTrial = [&](size_t i) {
+		CompressOptions candidate = options;
+		candidate.runTolerance = tolerances[i];
+		trials[i] = tryColourFormat(sample, pixels.height, noColours, candidate);
+	};
+	if (pool != nullptr && pool->size() > 1) { pool->parallelFor(tolerances.size(), runTrial); }
+	else {
+		for (size_t i = 0; i < tolerances.size(); i++) { runTrial(i); }
+	}
+
+	std::cout << "[Info] Run tolerance, from " << sample.height << " of " << pixels.height << " rows:" << std::endl;
+	for (size_t i = 0; i < tolerances.size(); i++) {
+		std::cout << "	" << static_cast<int>(tolerances[i]) << ": ~" << trials[i].estimatedBytes << " bytes, PSNR ";
+		if (std::isinf(trials[i].psnr)) { std::cout << "lossless"; }
+		else { std::cout << trials[i].psnr << "dB"; }
+		std::cout << (tolerances[i] == options.runTolerance ? " <- chosen" : "") << std::endl;
+	}
+}
+
+// Encodes one image. The header is filled in and the palette and pixel data are left in 'buffers'.
+// Bands of large images, and the auto format's candidates, are encoded on 'pool' when one is given.
+void encodeImage(BMPView& sourceView, const CompressOptions& runOptions, WorkStealingPool* pool, CompressBuffers& buffers, CompressedImage& finalFile) {
+	// Nothing from the previous image is still using the arena
+	buffers.arena.reset();
+	ArenaScope scratch(buffers.arena);
+	uint64_t rowReadsBefore = sourceView.rowReads();
+
+	CompressOptions options = runOptions;
+	//Resize image if necessary
+	bool resize = options.width > 0 || options.height > 0;
+	Image resizedImage;
+	if (resize) {
+		Image sourceImage;
+		sourceView.decode(sourceImage);
+		resizedImage = resizeImage(sourceImage, options.width > 0 ? options.width : sourceView.width, options.height > 0 ? options.height : sourceView.height);
+		if (options.verbose) { std::cout << "[Info] New Dimensions: W:" << resizedImage.width << " H:" << resizedImage.height << std::endl; }
+	}
+	uint32_t outputWidth = resize ? resizedImage.width : sourceView.width;
+	uint32_t outputHeight = resize ? resizedImage.height : sourceView.height;
+	std::optional<ImageColours> colours;
+	if (options.autoFormat) {
+		if (resize) { selectColourFormat(resizedImage, options, pool, colours); }
+		else { selectColourFormat(sourceView, options, pool, colours); }
+	}
+	if (options.runReport) {
+		if (resize) { reportRunTolerances(resizedImage, options, pool); }
+		else { reportRunTolerances(sourceView, options, pool); }
+	}
+
+	bitvector& rledDataStream = buffers.data;
+	bitvector& outputPalette = buffers.palette;
+	rledDataStream.clear();
+	outputPalette.clear();
+	rledDataStream.reserve(static_cast<size_t>(outputWidth) * outputHeight * options.unitLength);
+	if (resize) { encodePixels(resizedImage, options, colours, pool, rledDataStream, outputPalette); }
+	else { encodePixels(sourceView, options, colours, pool, rledDataStream, outputPalette); }
+
+	fillHeader(options, outputWidth, outputHeight, outputPalette, rledDataStream.byte_size(), finalFile);
+
+	// Each pass over the pixels reads every row once; sampled reads count the rows they touch
+	uint64_t rowReads = sourceView.rowReads() - rowReadsBefore;
+	if (options.verbose && sourceView.height > 0) {
+		std::cout << "[Info] Source reads: " << static_cast<double>(rowReads) / sourceView.height << " passes over the pixels, " << rowReads * sourceView.rowBytes() / 1024 << "KB" << std::endl;
+	}
+}
+
+// .rlei headers and stripe tables hold 32-bit sizes, so larger files are turned away rather than written with
+// them cut short
+bool fitsRLEISize(const std::string& destinationPath, uint64_t paletteBytes, uint64_t dataBytes) {
+	if (compressedImageHeaderSize + paletteBytes + dataBytes <= UINT32_MAX) { return true; }
+	std::cerr << "[Error] " << destinationPath << " would be larger than the 4GB an .rlei file can describe" << std::endl;
+	return false;
+}
+
+bool writeRLEI(const std::string& destinationPath, const CompressedImage& finalFile, std::span<const uint8_t> palette, std::span<const uint8_t> data) {
+	if (!fitsRLEISize(destinationPath, palette.size(), data.size())) { return false; }
+	uint8_t header[compressedImageHeaderSize];
+	serialiseCompressedImageHeader(finalFile, header);
+	auto outputFile = std::fstream(destinationPath, std::ios::binary | std::ios::out);
+	outputFile.write(reinterpret_cast<const char*>(header), compressedImageHeaderSize);
+	outputFile.write(reinterpret_cast<const char*>(palette.data()), palette.size());
+	outputFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+	outputFile.close();
+	if (!outputFile) {
+		std::cerr << "[Error] Failed to write " << destinationPath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// .rlei headers hold 16-bit dimensions, so images that would come out larger, after any resize, are turned away
+// rather than written with them cut short
+bool fitsRLEI(const std::string& sourcePath, const CompressOptions& options, uint32_t sourceWidth, uint32_t sourceHeight) {
+	uint32_t width = options.width > 0 ? static_cast<uint32_t>(options.width) : sourceWidth;
+	uint32_t height = options.height > 0 ? static_cast<uint32_t>(options.height) : sourceHeight;
+	if (width <= UINT16_MAX && height <= UINT16_MAX) { return true; }
+	std::cerr << "[Error] " << sourcePath << " is too large for an .rlei file, which holds at most 65535 by 65535 pixels" << std::endl;
+	return false;
+}
+
+// Compresses one bitmap to an .rlei file
+bool compressFile(const std::string& sourcePath, const std::string& destinationPath, const CompressOptions& options, WorkStealingPool* pool, CompressBuffers& buffers, CompressStats& stats) {
+	// The pixel array is read in place from the mapped file
+	MappedFile sourceFile;
+	BMPView sourceView;
+	if (!sourceFile.open(sourcePath) || !sourceView.open(sourceFile.data(), sourceFile.size())) {
+		std::cerr << "[Error] Failed to load bitmap: " << sourcePath << std::endl;
+		return false;
+	}
+	if (!fitsRLEI(sourcePath, options, sourceView.width, sourceView.height)) { return false; }
+	struct CompressedImage finalFile;
+	encodeImage(sourceView, options, pool, buffers, finalFile);
+	if (!writeRLEI(destinationPath, finalFile, buffers.palette.dump(), buffers.data.dump())) { return false; }
+	stats.sourceBytes += sourceFile.size();
+	stats.outputBytes += finalFile.imageSize;
+	return true;
+}
+
+// Compresses one bitmap to an .rlei file without holding the image or its codes in memory: rows are read from
+// the file a block at a time as they are encoded, finished codes are written out as they come, and the header
+// and any stripe table are written over placeholders once their sizes are known. Memory stays at a block of
+// source rows, plus one stripe when writing stripes, whatever the size of the image. Encodes on this thread.
+bool compressFileStreaming(const std::string& sourcePath, const std::string& destinationPath, const CompressOptions& runOptions, CompressStats& stats) {
+	BMPRowReader source;
+	if (!source.open(sourcePath)) {
+		std::cerr << "[Error] Failed to load bitmap: " << sourcePath << std::endl;
+		return false;
+	}
+	if (!fitsRLEI(sourcePath, runOptions, source.width, source.height)) { return false; }
+	CompressOptions options = runOptions;
+	std::optional<ImageColours> colours;
+	if (options.autoFormat) { selectColourFormat(source, options, nullptr, colours); }
+	if (options.runReport) { reportRunTolerances(source, options, nullptr); }
+	if (options.paletteBitWidth > 0 && !colours) { colours.emplace(countImageColours(source, options.paletteOptions)); }
+	bitvector palette;
+	UnitFormat format = prepareUnitFormat(colours ? &*colours : nullptr, options.colourFormat, options.paletteBitWidth, options.paletteFormat, options.paletteOptions.quantiser, options.verbose, palette);
+	prepareLowBitQuantisation(source, options.dither, options.runTolerance, nullptr, true, options.verbose, format);
+	colours.reset();
+
+	std::ofstream output(destinationPath, std::ios::binary | std::ios::trunc);
+	uint8_t header[compressedImageHeaderSize] = {};
+	output.write(reinterpret_cast<const char*>(header), compressedImageHeaderSize);
+	std::span<const uint8_t> paletteBytes = palette.dump();
+	output.write(reinterpret_cast<const char*>(paletteBytes.data()), paletteBytes.size());
+	uint64_t dataBytes = 0;
+	auto writeData = [&](std::span<const uint8_t> bytes) {
+		output.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+		dataBytes += bytes.size();
+	};
 
-		if (imgPaletteLUT.size() >= outPaletteLUT.size()) {
-			resultImage = convertBitmapToPalette(bitmap, paletteBitWidth, paletteFormatDesired);
+	auto encodeStart = std::chrono::steady_clock::now();
+	if (options.stripeHeight == 0) {
+		bitvector codes;
+		{
+			RunLengthEncoder encoder = RunLengthEncoder(codes, options.unitLength, options.packedLength, options.runCoding);
+			for (uint32_t y = 0; y < source.height; y++) {
+				encodeRows(source, y, y + 1, format, encoder);
+				codes.drain_words(writeData);
+			}
 		}
-		else {
-			resultImage = convertBitmapToFullPalette(bitmap, paletteBitWidth, paletteFormatDesired);
+		writeData(codes.dump());
+	}
+	else {
+		uint32_t stripeCount = std::max<uint32_t>((source.height + options.stripeHeight - 1) / options.stripeHeight, 1);
+		// Little-endian offsets from the end of the table, as encodeStripes writes them
+		std::vector<uint8_t> table(4 * (static_cast<size_t>(stripeCount) + 1), 0);
+		writeData(table);
+		UnitChannels channels = unitChannels(format.colourFormat, options.unitLength);
+		std::array<uint32_t, rowPredictorCount> predictorUse{};
+		bitvector stripe;
+		std::vector<uint8_t> block;
+		uint64_t offset = 0;
+		for (uint32_t i = 0; i < stripeCount; i++) {
+			uint32_t firstRow = i * options.stripeHeight;
+			uint32_t endRow = std::min<uint32_t>(firstRow + options.stripeHeight, source.height);
+			stripe.clear();
+			block.clear();
+			RowPredictor predictor = encodeStripe(source, format, channels, firstRow, endRow, options.unitLength, options.packedLength, options.runCoding, options.rowPrediction, options.entropyCoding, stripe, block);
+			predictorUse[static_cast<uint8_t>(predictor)]++;
+			std::span<const uint8_t> bytes = options.entropyCoding ? std::span<const uint8_t>(block) : stripe.dump();
+			writeData(bytes);
+			offset += bytes.size();
+			for (int byte = 0; byte < 4; byte++) { table[4 * (static_cast<size_t>(i) + 1) + byte] = static_cast<uint8_t>(offset >> (8 * byte)); }
+		}
+		output.seekp(static_cast<std::streamoff>(compressedImageHeaderSize + paletteBytes.size()));
+		output.write(reinterpret_cast<const char*>(table.data()), table.size());
+		if (options.verbose && options.rowPrediction) {
+			std::cout << "[Info] Row predictors: none " << predictorUse[0] << ", left " << predictorUse[1] << ", up " << predictorUse[2] << ", Paeth " << predictorUse[3] << " stripes" << std::endl;
 		}
-		rawDataStream = resultImage.image;
-		outputPalette = resultImage.palette;
 	}
-	case CompressedImageColourFormat::packedIndex2Bit: {
-		std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> extractedPalette = makeSmallOptimalPalette(1 << static_cast<uint32_t>(paletteBitWidth), *bitmap, false);
-		std::set<gdip::ARGB> imgPaletteLUT = getImageColours(bitmap);
-		std::set<gdip::ARGB> outPaletteLUT = makePaletteLUT(extractedPalette.get());
+	std::chrono::duration<double, std::milli> encodeTime = std::chrono::steady_clock::now() - encodeStart;
 
-		struct indexedImage resultImage;
+	// A file that cannot be finished is removed rather than left behind with a blank header
+	auto discardOutput = [&] {
+		output.close();
+		std::error_code error;
+		std::filesystem::remove(destinationPath, error);
+		return false;
+	};
+	if (!fitsRLEISize(destinationPath, paletteBytes.size(), dataBytes)) { return discardOutput(); }
+	if (source.failed()) {
+		std::cerr << "[Error] Failed to read bitmap: " << sourcePath << std::endl;
+		return discardOutput();
+	}
+	CompressedImage finalFile;
+	fillHeader(options, source.width, source.height, palette, static_cast<size_t>(dataBytes), finalFile);
+	serialiseCompressedImageHeader(finalFile, header);
+	output.seekp(0);
+	output.write(reinterpret_cast<const char*>(header), compressedImageHeaderSize);
+	output.close();
+	if (!output) {
+		std::cerr << "[Error] Failed to write " << destinationPath << std::endl;
+		return discardOutput();
+	}
+	if (options.verbose) {
+		std::cout << "[Info] Streamed " << source.height << " rows in " << encodeTime.count() << "ms" << std::endl;
+		if (source.height > 0) { std::cout << "[Info] Source reads: " << static_cast<double>(source.rowReads()) / source.height << " passes over the pixels, " << source.rowReads() * source.rowBytes() / 1024 << "KB" << std::endl; }
+	}
+	stats.sourceBytes += source.fileSize();
+	stats.outputBytes += finalFile.imageSize;
+	return true;
+}
 
-		if (imgPaletteLUT.size() >= outPaletteLUT.size()) {
-			resultImage = convertBitmapToPalette(bitmap, paletteBitWidth, paletteFormatDesired);
+// Lists the bitmaps to compress: every .bmp file in a directory, or the lines of a manifest file. Manifest
+// paths are relative to the manifest; blank lines and lines starting with '#' are skipped.
+bool listBatchSources(const std::filesystem::path& source, std::vector<std::filesystem::path>& sources) {
+	std::error_code error;
+	if (std::filesystem::is_directory(source, error)) {
+		for (const auto& entry : std::filesystem::directory_iterator(source, error)) {
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			if (entry.is_regular_file(error) && extension == ".bmp") { sources.push_back(entry.path()); }
 		}
-		else {
-			resultImage = convertBitmapToFullPalette(bitmap, paletteBitWidth, paletteFormatDesired);
-		}
-		rawDataStream = resultImage.image;
-		outputPalette = resultImage.palette;
-	}
-	case CompressedImageColourFormat::packedIndex4Bit: {
-		std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> extractedPalette = makeSmallOptimalPalette(1 << static_cast<uint32_t>(paletteBitWidth), *bitmap, false);
-		std::set<gdip::ARGB> imgPaletteLUT = getImageColours(bitmap);
-		std::set<gdip::ARGB> outPaletteLUT = makePaletteLUT(extractedPalette.get());
-		
-		struct indexedImage resultImage;
-		
-		if (imgPaletteLUT.size() >= outPaletteLUT.size()) {
-			resultImage = convertBitmapToPalette(bitmap, paletteBitWidth, paletteFormatDesired);
-		} else { 
-			resultImage = convertBitmapToFullPalette(bitmap, paletteBitWidth, paletteFormatDesired);
-		}
-		rawDataStream = resultImage.image;
-		outputPalette = resultImage.palette;
+		if (error) { return false; }
+		std::sort(sources.begin(), sources.end());
+		return true;
+	}
+	std::ifstream manifest(source);
+	if (!manifest) { return false; }
+	std::string line;
+	while (std::getline(manifest, line)) {
+		if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+		if (line.empty() || line[0] == '#') { continue; }
+		std::filesystem::path path(line);
+		sources.push_back(path.is_absolute() ? path : source.parent_path() / path);
+	}
+	return true;
+}
 
-		break;
+// One file on its way through the batch pipeline
+struct BatchJob {
+	std::filesystem::path source;
+	MappedFile file;
+	BMPView view;
+	CompressedImage header;
+	std::vector<uint8_t> palette;
+	std::vector<uint8_t> data;
+};
+
+// Time a pipeline stage spent working, as opposed to waiting on its queues
+struct StageTimer {
+	std::atomic<uint64_t> busyMicroseconds{ 0 };
+	std::atomic<uint64_t> items{ 0 };
+
+	template<typename Work>
+	void time(Work&& work) {
+		auto start = std::chrono::steady_clock::now();
+		work();
+		busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		items++;
 	}
-	case CompressedImageColourFormat::index8Bit: {
-		std::unique_ptr<gdip::ColorPalette, ColorPaletteDeleter> extractedPalette = makeSmallOptimalPalette(1 << static_cast<uint32_t>(paletteBitWidth), *bitmap, false);
-		std::set<gdip::ARGB> imgPaletteLUT = getImageColours(bitmap);
-		std::set<gdip::ARGB> outPaletteLUT = makePaletteLUT(extractedPalette.get());
+	void report(const char* name, size_t threads, double wallSeconds) const {
+		double busySeconds = busyMicroseconds.load() / 1e6;
+		std::cout << "[Info] " << name << ": " << items.load() << " files, " << threads << " thread" << (threads == 1 ? "" : "s") << ", busy " << 100.0 * busySeconds / (wallSeconds * threads) << "%" << std::endl;
+	}
+};
+
+template<typename T>
+void reportQueue(const char* name, const BoundedQueue<T>& queue) {
+	std::cout << "[Info] " << name << " queue: average occupancy " << queue.averageOccupancy() << " of " << queue.capacity() << ", " << queue.fullStallCount() << " full stalls, " << queue.emptyStallCount() << " empty stalls" << std::endl;
+}
 
-		struct indexedImage resultImage;
+// Compresses many bitmaps in one process. Reading, encoding and writing run as separate stages joined by bounded
+// queues, so the next files are already being read and the last ones written while others are encoded:
+// one reader thread maps each file and faults it in, 'threads' encoder threads compress, one writer thread
+// writes the results.
+int compressBatch(const std::string& sourceArg, const std::string& destinationArg, CompressOptions options, int threads) {
+	std::vector<std::filesystem::path> sources;
+	if (!listBatchSources(sourceArg, sources)) {
+		std::cerr << "[Error] Failed to read batch source: " << sourceArg << std::endl;
+		return 1;
+	}
+	std::filesystem::path destination(destinationArg);
+	std::error_code error;
+	std::filesystem::create_directories(destination, error);
+	if (!std::filesystem::is_directory(destination, error)) {
+		std::cerr << "[Error] Failed to create output directory: " << destinationArg << std::endl;
+		return 1;
+	}
 
-		if (imgPaletteLUT.size() >= outPaletteLUT.size()) {
-			resultImage = convertBitmapToPalette(bitmap, paletteBitWidth, paletteFormatDesired);
+	options.verbose = false;
+	size_t encoderCount = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	std::cout << "[Info] Compressing " << sources.size() << " files on " << encoderCount << " encoder threads" << std::endl;
+
+	// A couple of files per encoder in each queue is enough to hide the disk; more only holds memory
+	BoundedQueue<std::unique_ptr<BatchJob>> loaded(encoderCount * 2);
+	BoundedQueue<std::unique_ptr<BatchJob>> encoded(encoderCount * 2);
+	StageTimer readStage, encodeStage, writeStage;
+	std::atomic<size_t> failed{ 0 };
+	std::atomic<uint64_t> sourceBytes{ 0 }, outputBytes{ 0 };
+	std::atomic<uint64_t> arenaBaseline{ 0 }, arenaBlocks{ 0 }, arenaBytes{ 0 };
+	std::atomic<uint64_t> sourceRows{ 0 }, sourceRowReads{ 0 }, sourceBytesRead{ 0 };
+	uint64_t heapScratchBefore = scratchHeapAllocations();
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread reader([&] {
+		for (const std::filesystem::path& source : sources) {
+			auto job = std::make_unique<BatchJob>();
+			job->source = source;
+			bool ok = false;
+			readStage.time([&] {
+				ok = job->file.open(source.string()) && job->view.open(job->file.data(), job->file.size());
+				if (ok) { job->file.prefault(); }
+			});
+			if (!ok) {
+				std::cerr << "[Error] Failed to load bitmap: " << source.string() << std::endl;
+				failed++;
+				continue;
+			}
+			if (!fitsRLEI(source.string(), options, job->view.width, job->view.height)) {
+				failed++;
+				continue;
+			}
+			loaded.push(std::move(job));
 		}
-		else {
-			resultImage = convertBitmapToFullPalette(bitmap, paletteBitWidth, paletteFormatDesired);
+		loaded.close();
+	});
+
+	std::vector<std::thread> encoders;
+	for (size_t i = 0; i < encoderCount; i++) {
+		encoders.emplace_back([&] {
+			// Kept from one file to the next
+			CompressBuffers buffers;
+			std::unique_ptr<BatchJob> job;
+			bool first = true;
+			while (loaded.pop(job)) {
+				encodeStage.time([&] {
+					encodeImage(job->view, options, nullptr, buffers, job->header);
+					std::span<const uint8_t> palette = buffers.palette.dump(), data = buffers.data.dump();
+					job->palette.assign(palette.begin(), palette.end());
+					job->data.assign(data.begin(), data.end());
+				});
+				sourceBytes += job->file.size();
+				sourceRows += job->view.height;
+				sourceRowReads += job->view.rowReads();
+				sourceBytesRead += job->view.rowReads() * job->view.rowBytes();
+				job->file.close();
+				encoded.push(std::move(job));
+				// The first file sizes the arena; a steady state takes no more blocks from the heap
+				if (first) { arenaBaseline += buffers.arena.blockAllocations(); }
+				first = false;
+			}
+			arenaBlocks += buffers.arena.blockAllocations();
+			arenaBytes += buffers.arena.capacity();
+		});
+	}
+
+	std::thread writer([&] {
+		std::unique_ptr<BatchJob> job;
+		while (encoded.pop(job)) {
+			bool ok = false;
+			writeStage.time([&] {
+				std::filesystem::path outputPath = destination / job->source.filename().replace_extension(".rlei");
+				ok = writeRLEI(outputPath.string(), job->header, job->palette, job->data);
+			});
+			if (ok) { outputBytes += job->header.imageSize; }
+			else { failed++; }
 		}
-		rawDataStream = resultImage.image;
-		outputPalette = resultImage.palette;
+	});
+
+	reader.join();
+	for (std::thread& encoder : encoders) { encoder.join(); }
+	encoded.close();
+	writer.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	size_t compressed = sources.size() - failed;
+	double seconds = std::max(elapsed.count(), 1e-9);
+	std::cout << "[Info] Compressed " << compressed << " of " << sources.size() << " files in " << elapsed.count() << "s" << std::endl;
+	std::cout << "[Info] " << compressed / seconds << " files/s, " << sourceBytes / seconds / (1024 * 1024) << " MB/s";
+	if (outputBytes > 0) { std::cout << ", compression ratio " << static_cast<double>(sourceBytes) / outputBytes << ":1"; }
+	std::cout << std::endl;
+	readStage.report("Read", 1, seconds);
+	reportQueue("Read -> encode", loaded);
+	encodeStage.report("Encode", encoderCount, seconds);
+	reportQueue("Encode -> write", encoded);
+	writeStage.report("Write", 1, seconds);
+	std::cout << "[Info] Scratch arenas: " << arenaBytes / 1024 << "KB, " << arenaBlocks - arenaBaseline << " heap blocks after each encoder's first file, " << scratchHeapAllocations() - heapScratchBefore << " scratch allocations outside an arena" << std::endl;
+	if (sourceRows > 0) {
+		std::cout << "[Info] Source reads: " << static_cast<double>(sourceRowReads) / sourceRows << " passes over the pixels, " << sourceBytesRead / (1024 * 1024) << "MB" << std::endl;
+	}
+	return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, const char** argv)
+{
+	std::unordered_map<std::string, CLIArg> cliArgs;
+	if (argc <= 1) {
+		cliArgs = parseArgs(sizeof(defaultArgv) / sizeof(defaultArgv[0]), defaultArgv, sizeof(cliArgCfg) / sizeof(cliArgCfg[0]), cliArgCfg);
+		std::cout << "[Warn] No Args Supplied, using default args" << std::endl;
 	}
+	else {
+		//Parse and check args
+		cliArgs = parseArgs(argc, argv, sizeof(cliArgCfg) / sizeof(cliArgCfg[0]), cliArgCfg);
+		std::cout << "[Info] Supplied Arguments: " << std::endl;
+	}
+	
+	for (std::pair<std::string, CLIArg> arg : cliArgs) { std::cout << cliargtoa(arg.second); }
+	std::cout << std::endl;
+	if (cliArgs.size() == 0) {
+		std::cerr << "[Error] No Arguments. Terminating." << std::endl; return 1;
 	}
 
+	int threads = 0;
+	if (cliArgs.contains("--threads")) {
+		if (!getFromVariantOptional(cliArgs.at("--threads").value, &threads) || threads <= 0) {
+			std::cerr << "[Error] Misformatted Argument: --threads (-j)" << std::endl << "	Expected: Positive Integer" << std::endl;
+			return 1;
+		}
+	}
 
-	rledDataStream = runLengthEncode(rawDataStream, unitLength, packedLength);
+	if (cliArgs.contains("--decompress")) {
+		return decompressFile(cliArgs, threads);
+	}
 
-	struct CompressedImage finalFile;
-	finalFile.identifier[0] = 'R';
-	finalFile.identifier[1] = 'L';
-	finalFile.identifier[2] = 'E';
-	finalFile.identifier[3] = 'I';
-	finalFile.version = 1;
-	finalFile.imageSize = outputPalette.byte_size() + rledDataStream.byte_size() + sizeof(CompressedImage) - 2 * sizeof(void*);
-	finalFile.width = bitmap->GetWidth();
-	finalFile.height = bitmap->GetHeight();
-	finalFile.imageDataSizeBytes = rledDataStream.byte_size();
-	finalFile.colourFormat = colourFormatDesired;
-	finalFile.packedLength = packedLength;
-	finalFile.unitLength = unitLength;
-	finalFile.paletteSize = outputPalette.byte_size() / (8 / paletteBitWidth);
-	finalFile.padding1 = 0;
-	finalFile.paletteSizeBytes = outputPalette.byte_size();
-	finalFile.padding2 = 0;
-	finalFile.paletteColourFormat = paletteFormatDesired;
-	finalFile.padding3 = 0;
-	finalFile.palette = nullptr;
-	finalFile.imageData = nullptr;
-
-	CLIArg outputFileNameArg = cliArgs.at("--destination");
-	std::string outputFileName;
-	if (!getFromVariantOptional(outputFileNameArg.value, &outputFileName)) {
+	CompressOptions options;
+	if (!parseCompressOptions(cliArgs, options)) { return 1; }
+
+	std::string sourcePath, destinationPath;
+	if (!getFromVariantOptional(cliArgs.at("--source").value, &sourcePath)) {
+		std::cerr << "[Error] Failed to load bitmap." << std::endl;
+		return 1;
+	}
+	if (!getFromVariantOptional(cliArgs.at("--destination").value, &destinationPath)) {
 		std::cerr << "[Error] File Path Required" << std::endl;
 		return 1;
 	}
-	
-	auto outputFile = std::fstream(outputFileName, std::ios::binary | std::ios::out);
-	outputFile.write(reinterpret_cast<char*>(&finalFile), sizeof(CompressedImage) - 2 * sizeof(void*));
-	auto palOut = outputPalette.dump();
-	outputFile.write(reinterpret_cast<const char*>(palOut.data()), palOut.size());
-	auto imgOut = rledDataStream.dump();
-	outputFile.write(reinterpret_cast<const char*>(imgOut.data()), imgOut.size());
-	outputFile.close();
 
-	bitvector().swap(outputPalette);
-	bitvector().swap(rledDataStream);
+	if (cliArgs.contains("--batch")) {
+		if (cliArgs.contains("--stream")) { std::cout << "[Warn] --stream does not apply to --batch" << std::endl; }
+		return compressBatch(sourcePath, destinationPath, options, threads);
+	}
+	if (cliArgs.contains("--stream")) {
+		if (options.width > 0 || options.height > 0) {
+			std::cerr << "[Error] --stream (-z) cannot resize the image" << std::endl;
+			return 1;
+		}
+		CompressStats stats;
+		return compressFileStreaming(sourcePath, destinationPath, options, stats) ? 0 : 1;
+	}
 
-	return 0;
+	std::unique_ptr<WorkStealingPool> pool;
+	if (threads != 1) { pool = std::make_unique<WorkStealingPool>(threads); }
+	CompressBuffers buffers;
+	CompressStats stats;
+	return compressFile(sourcePath, destinationPath, options, pool.get(), buffers, stats) ? 0 : 1;
 }
-
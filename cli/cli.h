@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include "runcoding.h"
 
 #define abs(x) (x < 0 ? -x : x)
 #define sign(x) (x < 0 ? -1 : (x > 0 ? 1 : 0))
@@ -34,7 +35,8 @@ enum class CompressedImagePaletteFormat {
 
 struct CompressedImage {
 	char identifier[4];
-	uint32_t version;
+	uint16_t version;
+	uint16_t rowPrediction;	// 1: each stripe starts with the RowPredictor its rows are coded against
 	uint32_t imageSize;
 	uint16_t width;
 	uint16_t height;
@@ -43,11 +45,11 @@ struct CompressedImage {
 	uint8_t	unitLength;
 	uint8_t packedLength;
 	uint8_t paletteSize;
-	uint8_t padding1;
+	RunCoding runCoding;
 	uint16_t paletteSizeBytes;
-	uint16_t padding2;
+	uint16_t stripeHeight;	// versions 2 and 3: rows per stripe. 0 in version 1.
 	CompressedImagePaletteFormat paletteColourFormat;
-	uint32_t padding3;
+	uint32_t headerChecksum;	// CRC-32 of the bytes before it on disk, 0 if not written
 	void* palette;
 	void* imageData;
 };
\ No newline at end of file
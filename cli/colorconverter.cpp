@@ -3,27 +3,27 @@
 #include "colorconverter.h"
 
 ConvertibleColour* ConvertibleColour::fromColour555(colour555_t colour) {
-	red = ((colour & 0b0111110000000000) >> 10) / 31;
-	green = ((colour & 0b0000001111100000) >> 5) / 31;
-	blue = ((colour & 0b0000000000011111) >> 0) / 31;
+	red = ((colour & 0b0111110000000000) >> 10) / 31.0f;
+	green = ((colour & 0b0000001111100000) >> 5) / 31.0f;
+	blue = ((colour & 0b0000000000011111) >> 0) / 31.0f;
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromColour565(colour565_t colour) {
-	red = ((colour & 0b1111100000000000) >> 11) / 31;
-	green = ((colour & 0b0000011111100000) >> 5) / 63;
-	blue = ((colour & 0b0000000000011111) >> 0) / 31;
+	red = ((colour & 0b1111100000000000) >> 11) / 31.0f;
+	green = ((colour & 0b0000011111100000) >> 5) / 63.0f;
+	blue = ((colour & 0b0000000000011111) >> 0) / 31.0f;
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromColour24Bit(colour24_t colour) {
-	red = colour.R / 255;
-	green = colour.G / 255;
-	blue = colour.B / 255;
+	red = colour.R / 255.0f;
+	green = colour.G / 255.0f;
+	blue = colour.B / 255.0f;
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromColour3Bytes(uint8_t R, uint8_t G, uint8_t B) {
-	red = R / 255;
-	green = G / 255;
-	blue = B / 255;
+	red = R / 255.0f;
+	green = G / 255.0f;
+	blue = B / 255.0f;
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromColour3Bit(colour3_t colour) {
@@ -33,12 +33,12 @@ ConvertibleColour* ConvertibleColour::fromColour3Bit(colour3_t colour) {
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromColour6Bit(colour6_t colour) {
-	red = ((colour & 0b110000) >> 4) / 3;
-	green = ((colour & 0b001100) >> 2) / 3;
-	blue = ((colour & 0b000011) >> 0) / 3;
+	red = ((colour & 0b110000) >> 4) / 3.0f;
+	green = ((colour & 0b001100) >> 2) / 3.0f;
+	blue = ((colour & 0b000011) >> 0) / 3.0f;
 	return this;
 }
-ConvertibleColour* ConvertibleColour::fromColourARGB(Gdiplus::ARGB colour) {
+ConvertibleColour* ConvertibleColour::fromColourARGB(ARGB colour) {
 	uint32_t rawred = (static_cast<uint32_t>(colour) & 0x00FF0000) >> 16;	// Extract the Red channel
 	uint32_t rawgreen = (static_cast<uint32_t>(colour) & 0x0000FF00) >> 8;	// Extract the Green channel
 	uint32_t rawblue = (static_cast<uint32_t>(colour) & 0x000000FF) >> 0;			// Extract the Blue channel (least significant byte)
@@ -48,21 +48,21 @@ ConvertibleColour* ConvertibleColour::fromColourARGB(Gdiplus::ARGB colour) {
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromGreyscale2Bit(greyscale2_t value) {
-	red = value / 3;
-	green = value / 3;
-	blue = value / 3;
+	red = value / 3.0f;
+	green = value / 3.0f;
+	blue = value / 3.0f;
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromGreyscale3Bit(greyscale3_t value) {
-	red = value / 7;
-	green = value / 7;
-	blue = value / 7;
+	red = value / 7.0f;
+	green = value / 7.0f;
+	blue = value / 7.0f;
 	return this;
 }
 ConvertibleColour* ConvertibleColour::fromGreyscale4Bit(greyscale4_t value) {
-	red = value / 15;
-	green = value / 15;
-	blue = value / 15;
+	red = value / 15.0f;
+	green = value / 15.0f;
+	blue = value / 15.0f;
 	return this;
 }
 ConvertibleColour::colour555_t ConvertibleColour::toColour555() {
@@ -90,38 +90,27 @@ ConvertibleColour::colour3_t ConvertibleColour::toColour3Bit() {
 	return redBits << 2 | greenBits << 1 | blueBits;
 }
 ConvertibleColour::colour6_t ConvertibleColour::toColour6Bit() {
-	uint8_t redBits = roundf(red * 2);
-	uint8_t greenBits = roundf(green * 2);
-	uint8_t blueBits = roundf(blue * 2);
+	uint8_t redBits = roundf(red * 3);
+	uint8_t greenBits = roundf(green * 3);
+	uint8_t blueBits = roundf(blue * 3);
 	return redBits << 4 | greenBits << 2 | blueBits;
 }
-Gdiplus::ARGB ConvertibleColour::toColourARGB() {
+ARGB ConvertibleColour::toColourARGB() {
 	uint8_t redBits = roundf(red * 255);
 	uint8_t greenBits = roundf(green * 255);
 	uint8_t blueBits = roundf(blue * 255);
 	return 0xff << 24 | redBits << 16 | greenBits << 8 | blueBits;
 }
+// Greyscale values are the mean of the three channels, so grey inputs keep their exact level
 ConvertibleColour::greyscale1_t ConvertibleColour::toGreyscale1Bit() {
-	if (red != green && red != blue) {
-		return 0xff;
-	}
-	return roundf(red);
+	return roundf((red + green + blue) / 3);
 }
 ConvertibleColour::greyscale2_t ConvertibleColour::toGreyscale2Bit() {
-	if (red != green && red != blue) {
-		return 0xff;
-	}
-	return roundf(red * 3);
+	return roundf((red + green + blue) / 3 * 3);
 }
 ConvertibleColour::greyscale3_t ConvertibleColour::toGreyscale3Bit() {
-	if (red != green && red != blue) {
-		return 0xff;
-	}
-	return roundf(red * 7);
+	return roundf((red + green + blue) / 3 * 7);
 }
 ConvertibleColour::greyscale4_t ConvertibleColour::toGreyscale4Bit() {
-	if (red != green && red != blue) {
-		return 0xff;
-	}
-	return roundf(red * 15);
+	return roundf((red + green + blue) / 3 * 15);
 }
@@ -1,10 +1,11 @@
 #pragma once
 #ifndef COLOR_CONVERTER
 #define COLOR_CONVERTER
-#include <windows.h>
-#include <gdiplus.h>
 #include <stdint.h>
 
+// 32bpp colour laid out as 0xAARRGGBB, matching the pixel layout of decoded bitmaps
+typedef uint32_t ARGB;
+
 class ConvertibleColour {
 private:
 	float red = 0;
@@ -13,7 +14,7 @@ private:
 public:
 	using colour555_t = uint16_t;
 	using colour565_t = uint16_t;
-	static struct colour24_t { uint8_t R; uint8_t G; uint8_t B; };
+	struct colour24_t { uint8_t R; uint8_t G; uint8_t B; };
 	using colour3_t = uint8_t;
 	using colour6_t = uint8_t;
 	using greyscale1_t = uint8_t;
@@ -28,7 +29,7 @@ public:
 	ConvertibleColour* fromColour3Bytes(uint8_t R, uint8_t G, uint8_t B);
 	ConvertibleColour* fromColour3Bit(colour3_t colour);
 	ConvertibleColour* fromColour6Bit(colour6_t colour);
-	ConvertibleColour* fromColourARGB(Gdiplus::ARGB colour);
+	ConvertibleColour* fromColourARGB(ARGB colour);
 	ConvertibleColour* fromGreyscale2Bit(greyscale2_t value);
 	ConvertibleColour* fromGreyscale3Bit(greyscale3_t value);
 	ConvertibleColour* fromGreyscale4Bit(greyscale4_t value);
@@ -37,7 +38,7 @@ public:
 	colour24_t toColour24Bit();
 	colour3_t toColour3Bit();
 	colour6_t toColour6Bit();
-	Gdiplus::ARGB toColourARGB();
+	ARGB toColourARGB();
 	greyscale1_t toGreyscale1Bit();
 	greyscale2_t toGreyscale2Bit();
 	greyscale3_t toGreyscale3Bit();
@@ -0,0 +1,35 @@
+#include "colourhistogram.h"
+#include "bmp.h"
+
+bool countColours16Bit(const BMPView& view, ColourHistogram& histogram, uint32_t sampleStep) {
+	const BMPInfo& info = view.header();
+	if (info.bitsPerPixel != 16) { return false; }
+
+	// 555 without alpha never looks at the top bit, so half the table is enough
+	uint32_t usedBits = info.redMask | info.greenMask | info.blueMask | info.alphaMask;
+	uint32_t valueMask = (usedBits & 0x8000) ? 0xffff : 0x7fff;
+	ScratchVector<uint32_t> table(static_cast<size_t>(valueMask) + 1, 0);
+	if (sampleStep == 0) { sampleStep = 1; }
+	for (uint32_t y = 0; y < view.height; y += sampleStep) {
+		const uint8_t* row = view.rawRow(y);
+		for (uint32_t x = 0; x < view.width; x += sampleStep) {
+			table[(row[x * 2] | row[x * 2 + 1] << 8) & valueMask]++;
+		}
+	}
+
+	// Convert every distinct value in one go by laying them out as a single bitmap row
+	ScratchVector<uint8_t> values;
+	ScratchVector<uint32_t> counts;
+	for (uint32_t value = 0; value <= valueMask; value++) {
+		if (table[value] == 0) { continue; }
+		values.push_back(value & 0xff);
+		values.push_back(value >> 8);
+		counts.push_back(table[value]);
+	}
+	BMPInfo valueRow = info;
+	valueRow.width = static_cast<uint32_t>(counts.size());
+	ScratchVector<ARGB> colours(counts.size());
+	convertBMPRow(valueRow, values.data(), colours.data());
+	for (size_t i = 0; i < colours.size(); i++) { histogram.add(colours[i], counts[i]); }
+	return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <bit>
+#include <vector>
+#include "colorconverter.h"
+#include "arena.h"
+
+class BMPView;
+
+// Counts how often each ARGB colour occurs. Open addressing with linear probing over a flat, power-of-two sized
+// table of (colour, count) slots; a count of zero marks an empty slot, so every colour value is a valid key.
+class ColourHistogram {
+public:
+	struct Entry {
+		ARGB colour;
+		uint32_t count;
+	};
+private:
+	ScratchVector<Entry> slots;
+	uint32_t shift = 32;
+	size_t used = 0;
+
+	size_t slotFor(ARGB colour) const { return static_cast<uint32_t>(colour * 2654435761u) >> shift; }
+	void grow() {
+		ScratchVector<Entry> old;
+		old.swap(slots);
+		size_t capacity = old.empty() ? 1024 : old.size() * 2;
+		slots.assign(capacity, Entry{ 0, 0 });
+		shift = 32 - static_cast<uint32_t>(std::countr_zero(capacity));
+		size_t mask = capacity - 1;
+		for (const Entry& entry : old) {
+			if (entry.count == 0) { continue; }
+			size_t i = slotFor(entry.colour);
+			while (slots[i].count != 0) { i = (i + 1) & mask; }
+			slots[i] = entry;
+		}
+	}
+public:
+	ColourHistogram() { grow(); }
+	// Presize for roughly 'expectedColours' distinct colours
+	explicit ColourHistogram(size_t expectedColours) {
+		size_t capacity = 1024;
+		while (capacity * 3 < expectedColours * 4) { capacity *= 2; }
+		slots.assign(capacity, Entry{ 0, 0 });
+		shift = 32 - static_cast<uint32_t>(std::countr_zero(capacity));
+	}
+
+	void add(ARGB colour, uint32_t count = 1) {
+		size_t mask = slots.size() - 1;
+		size_t i = slotFor(colour);
+		while (slots[i].count != 0) {
+			if (slots[i].colour == colour) { slots[i].count += count; return; }
+			i = (i + 1) & mask;
+		}
+		slots[i] = Entry{ colour, count };
+		if (++used * 4 >= slots.size() * 3) { grow(); }
+	}
+	// Adds a row of pixels, counting runs of the same colour with a single lookup
+	void addRow(const ARGB* row, uint32_t width) {
+		uint32_t x = 0;
+		while (x < width) {
+			ARGB colour = row[x];
+			uint32_t runEnd = x + 1;
+			while (runEnd < width && row[runEnd] == colour) { runEnd++; }
+			add(colour, runEnd - x);
+			x = runEnd;
+		}
+	}
+	uint32_t count(ARGB colour) const {
+		size_t mask = slots.size() - 1;
+		for (size_t i = slotFor(colour); slots[i].count != 0; i = (i + 1) & mask) {
+			if (slots[i].colour == colour) { return slots[i].count; }
+		}
+		return 0;
+	}
+	bool contains(ARGB colour) const { return count(colour) != 0; }
+	// Number of distinct colours
+	size_t size() const { return used; }
+	bool empty() const { return used == 0; }
+	// All distinct colours with their counts, in no particular order
+	ScratchVector<Entry> entries() const {
+		ScratchVector<Entry> result;
+		result.reserve(used);
+		for (const Entry& entry : slots) {
+			if (entry.count != 0) { result.push_back(entry); }
+		}
+		return result;
+	}
+};
+
+// 16bpp fast path: counts the raw pixel values of a 16-bit bitmap in a direct 2^15 or 2^16 entry table and
+// converts each distinct value to ARGB once. Only every sampleStep-th pixel of every sampleStep-th row is counted.
+// Returns false, leaving 'histogram' untouched, for other depths.
+bool countColours16Bit(const BMPView& view, ColourHistogram& histogram, uint32_t sampleStep = 1);
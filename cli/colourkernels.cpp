@@ -0,0 +1,266 @@
+#include "colourkernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define COLOURKERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets any function use any intrinsic
+#define COLOURKERNELS_TARGET(isa)
+#else
+#define COLOURKERNELS_TARGET(isa) __attribute__((target(isa)))
+#endif
+#else
+#define COLOURKERNELS_X86 0
+#endif
+
+namespace {
+	// round(value * levels / range) for non-negative values, without floats
+	constexpr uint32_t scaleRounded(uint32_t value, uint32_t levels, uint32_t range) {
+		return (2 * value * levels + range) / (2 * range);
+	}
+
+	struct KernelTables {
+		uint16_t red555[256], green555[256], blue5[256];
+		uint16_t red565[256], green565[256];
+		uint8_t red3[256], green3[256], blue3[256];
+		uint8_t red6[256], green6[256], blue6[256];
+		// Indexed by R + G + B
+		uint8_t grey[4][766];
+
+		KernelTables() {
+			for (uint32_t v = 0; v < 256; v++) {
+				red555[v] = static_cast<uint16_t>(scaleRounded(v, 31, 255) << 10);
+				green555[v] = static_cast<uint16_t>(scaleRounded(v, 31, 255) << 5);
+				blue5[v] = static_cast<uint16_t>(scaleRounded(v, 31, 255));
+				red565[v] = static_cast<uint16_t>(scaleRounded(v, 31, 255) << 11);
+				green565[v] = static_cast<uint16_t>(scaleRounded(v, 63, 255) << 5);
+				red3[v] = static_cast<uint8_t>(scaleRounded(v, 1, 255) << 2);
+				green3[v] = static_cast<uint8_t>(scaleRounded(v, 1, 255) << 1);
+				blue3[v] = static_cast<uint8_t>(scaleRounded(v, 1, 255));
+				red6[v] = static_cast<uint8_t>(scaleRounded(v, 3, 255) << 4);
+				green6[v] = static_cast<uint8_t>(scaleRounded(v, 3, 255) << 2);
+				blue6[v] = static_cast<uint8_t>(scaleRounded(v, 3, 255));
+			}
+			for (uint32_t bits = 1; bits <= 4; bits++) {
+				for (uint32_t sum = 0; sum < 766; sum++) { grey[bits - 1][sum] = static_cast<uint8_t>(scaleRounded(sum, (1 << bits) - 1, 765)); }
+			}
+		}
+	};
+
+	const KernelTables& tables() {
+		static const KernelTables instance;
+		return instance;
+	}
+
+	inline uint32_t red(ARGB colour) { return (colour >> 16) & 0xff; }
+	inline uint32_t green(ARGB colour) { return (colour >> 8) & 0xff; }
+	inline uint32_t blue(ARGB colour) { return colour & 0xff; }
+
+	template<bool is565>
+	void packARGBScalar(const ARGB* row, uint32_t width, uint16_t* out) {
+		const KernelTables& t = tables();
+		const uint16_t* redTable = is565 ? t.red565 : t.red555;
+		const uint16_t* greenTable = is565 ? t.green565 : t.green555;
+		for (uint32_t x = 0; x < width; x++) { out[x] = redTable[red(row[x])] | greenTable[green(row[x])] | t.blue5[blue(row[x])]; }
+	}
+
+	template<bool is565>
+	void packBGRScalar(const uint8_t* row, uint32_t width, uint16_t* out) {
+		const KernelTables& t = tables();
+		const uint16_t* redTable = is565 ? t.red565 : t.red555;
+		const uint16_t* greenTable = is565 ? t.green565 : t.green555;
+		for (uint32_t x = 0; x < width; x++, row += 3) { out[x] = redTable[row[2]] | greenTable[row[1]] | t.blue5[row[0]]; }
+	}
+
+#if COLOURKERNELS_X86
+	// The SIMD kernels work on 32-bit lanes holding one xRGB pixel each. Every channel is scaled with
+	// round(c * levels / 255) = (x + 128 + ((x + 128) >> 8)) >> 8 where x = c * levels, which is exact for
+	// x < 65536 and so matches scaleRounded.
+
+	// Byte shuffle turning 12 bytes of B, G, R triples into four 0RGB lanes
+	#define COLOURKERNELS_BGR_SHUFFLE 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+
+	template<bool is565>
+	COLOURKERNELS_TARGET("sse4.1") inline __m128i packLanesSSE41(__m128i pixels) {
+		const __m128i mask = _mm_set1_epi32(0xff);
+		const __m128i bias = _mm_set1_epi32(128);
+		const __m128i levels5 = _mm_set1_epi32(31);
+		const __m128i levelsGreen = _mm_set1_epi32(is565 ? 63 : 31);
+		__m128i r = _mm_add_epi32(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(pixels, 16), mask), levels5), bias);
+		__m128i g = _mm_add_epi32(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(pixels, 8), mask), levelsGreen), bias);
+		__m128i b = _mm_add_epi32(_mm_mullo_epi16(_mm_and_si128(pixels, mask), levels5), bias);
+		r = _mm_srli_epi32(_mm_add_epi32(r, _mm_srli_epi32(r, 8)), 8);
+		g = _mm_srli_epi32(_mm_add_epi32(g, _mm_srli_epi32(g, 8)), 8);
+		b = _mm_srli_epi32(_mm_add_epi32(b, _mm_srli_epi32(b, 8)), 8);
+		return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, is565 ? 11 : 10), _mm_slli_epi32(g, 5)), b);
+	}
+
+	template<bool is565>
+	COLOURKERNELS_TARGET("sse4.1") void packARGBSSE41(const ARGB* row, uint32_t width, uint16_t* out) {
+		uint32_t x = 0;
+		for (; x + 8 <= width; x += 8) {
+			__m128i low = packLanesSSE41<is565>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)));
+			__m128i high = packLanesSSE41<is565>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 4)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi32(low, high));
+		}
+		packARGBScalar<is565>(row + x, width - x, out + x);
+	}
+
+	template<bool is565>
+	COLOURKERNELS_TARGET("sse4.1") void packBGRSSE41(const uint8_t* row, uint32_t width, uint16_t* out) {
+		const __m128i shuffle = _mm_setr_epi8(COLOURKERNELS_BGR_SHUFFLE);
+		uint32_t x = 0;
+		// Each load reads 16 bytes for 12 bytes of pixels, so stop while the reads stay inside the row
+		for (; (x + 8) * 3 + 4 <= width * 3; x += 8) {
+			const uint8_t* pixels = row + x * 3;
+			__m128i low = packLanesSSE41<is565>(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels)), shuffle));
+			__m128i high = packLanesSSE41<is565>(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 12)), shuffle));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi32(low, high));
+		}
+		packBGRScalar<is565>(row + x * 3, width - x, out + x);
+	}
+
+	template<bool is565>
+	COLOURKERNELS_TARGET("avx2") inline __m256i packLanesAVX2(__m256i pixels) {
+		const __m256i mask = _mm256_set1_epi32(0xff);
+		const __m256i bias = _mm256_set1_epi32(128);
+		const __m256i levels5 = _mm256_set1_epi32(31);
+		const __m256i levelsGreen = _mm256_set1_epi32(is565 ? 63 : 31);
+		__m256i r = _mm256_add_epi32(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask), levels5), bias);
+		__m256i g = _mm256_add_epi32(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask), levelsGreen), bias);
+		__m256i b = _mm256_add_epi32(_mm256_mullo_epi16(_mm256_and_si256(pixels, mask), levels5), bias);
+		r = _mm256_srli_epi32(_mm256_add_epi32(r, _mm256_srli_epi32(r, 8)), 8);
+		g = _mm256_srli_epi32(_mm256_add_epi32(g, _mm256_srli_epi32(g, 8)), 8);
+		b = _mm256_srli_epi32(_mm256_add_epi32(b, _mm256_srli_epi32(b, 8)), 8);
+		return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, is565 ? 11 : 10), _mm256_slli_epi32(g, 5)), b);
+	}
+
+	// packus works within 128-bit halves, so put the four 64-bit quarters back in order
+	COLOURKERNELS_TARGET("avx2") inline __m256i pack16AVX2(__m256i low, __m256i high) {
+		return _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xd8);
+	}
+
+	template<bool is565>
+	COLOURKERNELS_TARGET("avx2") void packARGBAVX2(const ARGB* row, uint32_t width, uint16_t* out) {
+		uint32_t x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m256i low = packLanesAVX2<is565>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x)));
+			__m256i high = packLanesAVX2<is565>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x + 8)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), pack16AVX2(low, high));
+		}
+		packARGBScalar<is565>(row + x, width - x, out + x);
+	}
+
+	COLOURKERNELS_TARGET("avx2") inline __m256i loadBGR8AVX2(const uint8_t* pixels, __m256i shuffle) {
+		__m256i both = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels))), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 12)), 1);
+		return _mm256_shuffle_epi8(both, shuffle);
+	}
+
+	template<bool is565>
+	COLOURKERNELS_TARGET("avx2") void packBGRAVX2(const uint8_t* row, uint32_t width, uint16_t* out) {
+		const __m256i shuffle = _mm256_setr_epi8(COLOURKERNELS_BGR_SHUFFLE, COLOURKERNELS_BGR_SHUFFLE);
+		uint32_t x = 0;
+		for (; (x + 16) * 3 + 4 <= width * 3; x += 16) {
+			const uint8_t* pixels = row + x * 3;
+			__m256i low = packLanesAVX2<is565>(loadBGR8AVX2(pixels, shuffle));
+			__m256i high = packLanesAVX2<is565>(loadBGR8AVX2(pixels + 24, shuffle));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), pack16AVX2(low, high));
+		}
+		packBGRScalar<is565>(row + x * 3, width - x, out + x);
+	}
+#endif
+
+	KernelISA bestSupportedISA() {
+		if (kernelISASupported(KernelISA::avx2)) { return KernelISA::avx2; }
+		if (kernelISASupported(KernelISA::sse41)) { return KernelISA::sse41; }
+		return KernelISA::scalar;
+	}
+
+	KernelISA& activeISA() {
+		static KernelISA isa = bestSupportedISA();
+		return isa;
+	}
+
+	template<bool is565>
+	void packARGB(const ARGB* row, uint32_t width, uint16_t* out) {
+		switch (activeISA()) {
+#if COLOURKERNELS_X86
+		case KernelISA::avx2: packARGBAVX2<is565>(row, width, out); return;
+		case KernelISA::sse41: packARGBSSE41<is565>(row, width, out); return;
+#endif
+		default: packARGBScalar<is565>(row, width, out); return;
+		}
+	}
+
+	template<bool is565>
+	void packBGR(const uint8_t* row, uint32_t width, uint16_t* out) {
+		switch (activeISA()) {
+#if COLOURKERNELS_X86
+		case KernelISA::avx2: packBGRAVX2<is565>(row, width, out); return;
+		case KernelISA::sse41: packBGRSSE41<is565>(row, width, out); return;
+#endif
+		default: packBGRScalar<is565>(row, width, out); return;
+		}
+	}
+}
+
+bool kernelISASupported(KernelISA isa) {
+	if (isa == KernelISA::scalar) { return true; }
+#if COLOURKERNELS_X86
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuid(registers, 0);
+	int maxLeaf = registers[0];
+	__cpuid(registers, 1);
+	bool sse41 = (registers[2] & (1 << 19)) != 0;
+	if (isa == KernelISA::sse41) { return sse41; }
+	// AVX2 also needs the OS to save the YMM registers
+	bool osSavesYmm = (registers[2] & (1 << 27)) != 0 && (registers[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	if (!osSavesYmm || maxLeaf < 7) { return false; }
+	__cpuidex(registers, 7, 0);
+	return (registers[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return isa == KernelISA::sse41 ? __builtin_cpu_supports("sse4.1") : __builtin_cpu_supports("avx2");
+#endif
+#else
+	return false;
+#endif
+}
+
+bool setKernelISA(KernelISA isa) {
+	if (!kernelISASupported(isa)) { return false; }
+	activeISA() = isa;
+	return true;
+}
+
+KernelISA kernelISA() { return activeISA(); }
+
+const char* kernelISAName(KernelISA isa) {
+	switch (isa) {
+	case KernelISA::sse41: return "SSE4.1";
+	case KernelISA::avx2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+void rowToColour555(const ARGB* row, uint32_t width, uint16_t* out) { packARGB<false>(row, width, out); }
+void rowToColour565(const ARGB* row, uint32_t width, uint16_t* out) { packARGB<true>(row, width, out); }
+void rowBGRToColour555(const uint8_t* row, uint32_t width, uint16_t* out) { packBGR<false>(row, width, out); }
+void rowBGRToColour565(const uint8_t* row, uint32_t width, uint16_t* out) { packBGR<true>(row, width, out); }
+
+void rowToColour3Bit(const ARGB* row, uint32_t width, uint8_t* out) {
+	const KernelTables& t = tables();
+	for (uint32_t x = 0; x < width; x++) { out[x] = t.red3[red(row[x])] | t.green3[green(row[x])] | t.blue3[blue(row[x])]; }
+}
+
+void rowToColour6Bit(const ARGB* row, uint32_t width, uint8_t* out) {
+	const KernelTables& t = tables();
+	for (uint32_t x = 0; x < width; x++) { out[x] = t.red6[red(row[x])] | t.green6[green(row[x])] | t.blue6[blue(row[x])]; }
+}
+
+void rowToGreyscale(const ARGB* row, uint32_t width, int bits, uint8_t* out) {
+	const uint8_t* grey = tables().grey[bits - 1];
+	for (uint32_t x = 0; x < width; x++) { out[x] = grey[red(row[x]) + green(row[x]) + blue(row[x])]; }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include "colorconverter.h"
+
+// Integer row kernels for the packed colour formats. Each one produces, for every pixel, exactly what
+// ConvertibleColour().fromColourARGB(pixel)->toX() does, but through 256-entry per-channel tables built once
+// instead of float maths per pixel. Alpha is ignored.
+
+// Instruction sets the 555/565 kernels can run on. The best one the CPU supports is chosen on first use.
+enum class KernelISA { scalar, sse41, avx2 };
+bool kernelISASupported(KernelISA isa);
+// Forces one implementation, for tests and benchmarks. Returns false, changing nothing, if the CPU lacks it.
+bool setKernelISA(KernelISA isa);
+KernelISA kernelISA();
+const char* kernelISAName(KernelISA isa);
+
+// 0RRRRRGGGGGBBBBB
+void rowToColour555(const ARGB* row, uint32_t width, uint16_t* out);
+// RRRRRGGGGGGBBBBB
+void rowToColour565(const ARGB* row, uint32_t width, uint16_t* out);
+// The same packing straight from the bytes of a 24bpp bitmap row (B, G, R per pixel)
+void rowBGRToColour555(const uint8_t* row, uint32_t width, uint16_t* out);
+void rowBGRToColour565(const uint8_t* row, uint32_t width, uint16_t* out);
+// 00000RGB
+void rowToColour3Bit(const ARGB* row, uint32_t width, uint8_t* out);
+// 00RRGGBB
+void rowToColour6Bit(const ARGB* row, uint32_t width, uint8_t* out);
+// Mean of the three channels at 1 to 4 bits
+void rowToGreyscale(const ARGB* row, uint32_t width, int bits, uint8_t* out);
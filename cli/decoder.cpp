@@ -0,0 +1,519 @@
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <array>
+#include <atomic>
+#include <bit>
+#include "bitvector.h"
+#include "threadpool.h"
+#include "rans.h"
+#include "prediction.h"
+#include "decoder.h"
+
+int paletteEntryBitWidth(CompressedImagePaletteFormat format) {
+	switch (format) {
+	case CompressedImagePaletteFormat::greyscale2Bit: return 2;
+	case CompressedImagePaletteFormat::colour3Bit: return 3;
+	case CompressedImagePaletteFormat::greyscale3Bit: return 3;
+	case CompressedImagePaletteFormat::greyscale4Bit: return 4;
+	case CompressedImagePaletteFormat::colour6Bit: return 6;
+	case CompressedImagePaletteFormat::colour555: return 16;
+	case CompressedImagePaletteFormat::colour565: return 16;
+	case CompressedImagePaletteFormat::colourFull: return 24;
+	default: return 0;
+	}
+}
+
+bool readCompressedImageHeader(const uint8_t* data, size_t size, CompressedImage& header) {
+	if (!parseCompressedImageHeader(data, size, header)) { return false; }
+	if (header.version < 1 || header.version > 3) {
+		std::cerr << "[Error] Unsupported compressed image version: " << header.version << std::endl;
+		return false;
+	}
+	if (header.unitLength == 0 || header.unitLength > 32 || header.packedLength <= header.unitLength || header.packedLength > 64) {
+		std::cerr << "[Error] Invalid unit length (" << +header.unitLength << ") or packed length (" << +header.packedLength << ")" << std::endl;
+		return false;
+	}
+	if (header.runCoding != RunCoding::fixedWidth && header.runCoding != RunCoding::expGolomb) {
+		std::cerr << "[Error] Unknown run coding: " << +static_cast<uint8_t>(header.runCoding) << std::endl;
+		return false;
+	}
+	if (header.rowPrediction > 1) {
+		std::cerr << "[Error] Unknown row prediction: " << header.rowPrediction << std::endl;
+		return false;
+	}
+	if (static_cast<size_t>(header.paletteSizeBytes) + header.imageDataSizeBytes > size - compressedImageHeaderSize) {
+		std::cerr << "[Error] Compressed image is truncated" << std::endl;
+		return false;
+	}
+	header.palette = const_cast<uint8_t*>(data) + compressedImageHeaderSize;
+	header.imageData = const_cast<uint8_t*>(data) + compressedImageHeaderSize + header.paletteSizeBytes;
+	if (header.version == 1) { return true; }
+
+	if (header.stripeHeight == 0) {
+		std::cerr << "[Error] Compressed image has a stripe height of 0" << std::endl;
+		return false;
+	}
+	size_t tableBytes = (static_cast<size_t>(stripeCount(header)) + 1) * 4;
+	if (tableBytes > header.imageDataSizeBytes) {
+		std::cerr << "[Error] Compressed image stripe table is truncated" << std::endl;
+		return false;
+	}
+	const uint8_t* table = static_cast<const uint8_t*>(header.imageData);
+	uint32_t previous = 0;
+	for (size_t i = 0; i * 4 < tableBytes; i++) {
+		uint32_t offset = loadLE32(table + i * 4);
+		if (offset < previous || (i == 0 && offset != 0)) {
+			std::cerr << "[Error] Compressed image stripe table is out of order" << std::endl;
+			return false;
+		}
+		previous = offset;
+	}
+	if (previous != header.imageDataSizeBytes - tableBytes) {
+		std::cerr << "[Error] Compressed image stripes do not fill the image data" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+uint32_t stripeRows(const CompressedImage& header) {
+	return header.version == 1 ? std::max<uint32_t>(header.height, 1) : header.stripeHeight;
+}
+
+uint32_t stripeCount(const CompressedImage& header) {
+	uint32_t rows = stripeRows(header);
+	return std::max<uint32_t>((header.height + rows - 1) / rows, 1);
+}
+
+void stripeStream(const CompressedImage& header, uint32_t stripe, const uint8_t*& stream, size_t& bytes) {
+	const uint8_t* data = static_cast<const uint8_t*>(header.imageData);
+	if (header.version == 1) {
+		stream = data;
+		bytes = header.imageDataSizeBytes;
+		return;
+	}
+	const uint8_t* stripes = data + (static_cast<size_t>(stripeCount(header)) + 1) * 4;
+	uint32_t begin = loadLE32(data + static_cast<size_t>(stripe) * 4);
+	uint32_t end = loadLE32(data + static_cast<size_t>(stripe) * 4 + 4);
+	stream = stripes + begin;
+	bytes = end - begin;
+}
+
+static void fill32(uint32_t* dst, uint32_t value, size_t count) {
+	std::fill_n(dst, count, value);
+}
+
+// Fills at least 16 pixels, and otherwise 'count' rounded up to a multiple of 8. Short runs, which are the
+// common case, take no data dependent branches, and the fixed-size blocks compile to plain vector stores.
+// The caller guarantees the extra pixels are in bounds.
+static void fill32Blocks(uint32_t* dst, uint32_t value, size_t count) {
+	for (size_t j = 0; j < 16; j++) { dst[j] = value; }
+	for (size_t i = 16; i < count; i += 8) {
+		for (size_t j = 0; j < 8; j++) { dst[i + j] = value; }
+	}
+}
+
+static uint32_t makeARGB(uint32_t r, uint32_t g, uint32_t b) { return 0xff000000 | r << 16 | g << 8 | b; }
+static uint32_t expand5Bit(uint32_t v) { return (v << 3) | (v >> 2); }
+static uint32_t expand6Bit(uint32_t v) { return (v << 2) | (v >> 4); }
+static uint32_t greyscaleToARGB(uint32_t value, uint32_t bits) {
+	uint32_t grey = (value & ((1 << bits) - 1)) * 255 / ((1 << bits) - 1);
+	return makeARGB(grey, grey, grey);
+}
+static uint32_t colour3BitToARGB(uint32_t v) { return makeARGB(v & 0b100 ? 255 : 0, v & 0b010 ? 255 : 0, v & 0b001 ? 255 : 0); }
+static uint32_t colour6BitToARGB(uint32_t v) { return makeARGB(((v >> 4) & 0x3) * 85, ((v >> 2) & 0x3) * 85, (v & 0x3) * 85); }
+static uint32_t colour555ToARGB(uint32_t v) { return makeARGB(expand5Bit((v >> 10) & 0x1f), expand5Bit((v >> 5) & 0x1f), expand5Bit(v & 0x1f)); }
+static uint32_t colour565ToARGB(uint32_t v) { return makeARGB(expand5Bit((v >> 11) & 0x1f), expand6Bit((v >> 5) & 0x3f), expand5Bit(v & 0x1f)); }
+
+static std::vector<uint32_t> readPalette(const CompressedImage& header) {
+	std::vector<uint32_t> palette;
+	int entryBits = paletteEntryBitWidth(header.paletteColourFormat);
+	if (entryBits == 0 || header.paletteSizeBytes == 0) { return palette; }
+	size_t count = std::min<size_t>(header.paletteSizeBytes * 8 / entryBits, 256);
+	bitreader reader = bitreader(static_cast<const uint8_t*>(header.palette), header.paletteSizeBytes);
+	palette.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		uint32_t v = static_cast<uint32_t>(reader.read(entryBits));
+		switch (header.paletteColourFormat) {
+		case CompressedImagePaletteFormat::greyscale2Bit: palette.push_back(greyscaleToARGB(v, 2)); break;
+		case CompressedImagePaletteFormat::greyscale3Bit: palette.push_back(greyscaleToARGB(v, 3)); break;
+		case CompressedImagePaletteFormat::greyscale4Bit: palette.push_back(greyscaleToARGB(v, 4)); break;
+		case CompressedImagePaletteFormat::colour3Bit: palette.push_back(colour3BitToARGB(v)); break;
+		case CompressedImagePaletteFormat::colour6Bit: palette.push_back(colour6BitToARGB(v)); break;
+		case CompressedImagePaletteFormat::colour555: palette.push_back(colour555ToARGB(v)); break;
+		case CompressedImagePaletteFormat::colour565: palette.push_back(colour565ToARGB(v)); break;
+		case CompressedImagePaletteFormat::colourFull: palette.push_back(makeARGB(v >> 16, (v >> 8) & 0xff, v & 0xff)); break;
+		default: break;
+		}
+	}
+	return palette;
+}
+
+// Maps every possible unit value of a format with units of 8 bits or fewer straight to its ARGB colour
+static bool makeUnitLUT(const CompressedImage& header, const std::vector<uint32_t>& palette, std::vector<uint32_t>& lut) {
+	uint32_t unitValues = 1 << header.unitLength;
+	lut.resize(unitValues);
+	for (uint32_t i = 0; i < unitValues; i++) {
+		switch (header.colourFormat) {
+		case CompressedImageColourFormat::packedIndexBit:
+		case CompressedImageColourFormat::packedIndex2Bit:
+		case CompressedImageColourFormat::packedIndex4Bit:
+		case CompressedImageColourFormat::index8Bit:
+			// Files written without a palette are shown as a greyscale ramp over the index range
+			if (palette.empty()) { lut[i] = greyscaleToARGB(i, header.unitLength); }
+			else { lut[i] = i < palette.size() ? palette[i] : makeARGB(0, 0, 0); }
+			break;
+		case CompressedImageColourFormat::packedGreyscale1Bit: lut[i] = greyscaleToARGB(i, 1); break;
+		case CompressedImageColourFormat::packedGreyscale2Bit: lut[i] = greyscaleToARGB(i, 2); break;
+		case CompressedImageColourFormat::packedGreyscale3Bit: lut[i] = greyscaleToARGB(i, 3); break;
+		case CompressedImageColourFormat::packedGreyscale4Bit: lut[i] = greyscaleToARGB(i, 4); break;
+		case CompressedImageColourFormat::packedColour3Bit: lut[i] = colour3BitToARGB(i); break;
+		case CompressedImageColourFormat::packedColour6Bit: lut[i] = colour6BitToARGB(i); break;
+		default:
+			std::cerr << "[Error] Colour format does not match unit length " << +header.unitLength << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+template<typename Convert>
+static size_t decodeRuns(const CompressedImage& header, const uint8_t* stream, size_t bytes, uint32_t* out, size_t pixelCount, Convert convert) {
+	bitreader reader = bitreader(stream, bytes);
+	uint32_t packingSpace = header.packedLength - header.unitLength;
+	uint64_t countMask = (uint64_t(1) << packingSpace) - 1;
+	size_t codeCount = bytes * 8 / header.packedLength;
+	size_t written = 0;
+	size_t codeNo = 0;
+	// While there is slack after the run, fill whole 8 pixel blocks and let the next run overwrite the excess
+	for (; codeNo < codeCount && written + countMask + 16 <= pixelCount; codeNo++) {
+		uint64_t code = reader.read(header.packedLength);
+		size_t count = code & countMask;
+		fill32Blocks(out + written, convert(static_cast<uint32_t>(code >> packingSpace)), count);
+		written += count;
+	}
+	for (; codeNo < codeCount && written < pixelCount; codeNo++) {
+		uint64_t code = reader.read(header.packedLength);
+		size_t count = std::min<size_t>(code & countMask, pixelCount - written);
+		fill32(out + written, convert(static_cast<uint32_t>(code >> packingSpace)), count);
+		written += count;
+	}
+	return written;
+}
+
+// Exp-Golomb codes short enough to be looked up whole from the next expGolombTableBits bits of the stream
+constexpr uint32_t expGolombTableBits = 12;
+struct ExpGolombCode {
+	uint16_t count;
+	uint8_t bits;	// 0 when the code is longer than the table covers
+};
+static const auto expGolombTable = [] {
+	std::array<ExpGolombCode, 1 << expGolombTableBits> table{};
+	for (uint32_t prefix = 1; prefix < table.size(); prefix++) {
+		uint32_t bits = 2 * (std::countl_zero(prefix) - (32 - expGolombTableBits)) + 1;
+		if (bits > expGolombTableBits) { continue; }
+		table[prefix] = ExpGolombCode{ static_cast<uint16_t>(prefix >> (expGolombTableBits - bits)), static_cast<uint8_t>(bits) };
+	}
+	return table;
+}();
+
+// Reads one Exp-Golomb run length. Returns false at the end of the stream, where only zero padding is left.
+static bool readExpGolomb(bitreader& reader, uint64_t& count) {
+	const ExpGolombCode& code = expGolombTable[reader.peek(expGolombTableBits)];
+	uint32_t bits = code.bits;
+	if (bits != 0) { count = code.count; }
+	else {
+		// Runs are at most 32 bits, so a code starts with at most 31 zeros
+		uint32_t next = reader.peek(32);
+		if (next == 0) { return false; }
+		bits = 2 * std::countl_zero(next) + 1;
+		if (bits > reader.remaining()) { return false; }
+		count = reader.read(bits);
+		return true;
+	}
+	if (bits > reader.remaining()) { return false; }
+	reader.skip(bits);
+	return true;
+}
+
+template<typename Convert>
+static size_t decodeExpGolombRuns(const CompressedImage& header, const uint8_t* stream, size_t bytes, uint32_t* out, size_t pixelCount, Convert convert) {
+	bitreader reader = bitreader(stream, bytes);
+	size_t written = 0;
+	uint64_t count;
+	while (written < pixelCount && reader.remaining() > header.unitLength) {
+		uint32_t unit = static_cast<uint32_t>(reader.read(header.unitLength));
+		if (!readExpGolomb(reader, count)) { break; }
+		// Runs are unbounded, so the block fill is only safe when there is room behind this one
+		if (written + count + 16 <= pixelCount) { fill32Blocks(out + written, convert(unit), count); }
+		else {
+			count = std::min<size_t>(count, pixelCount - written);
+			fill32(out + written, convert(unit), count);
+		}
+		written += count;
+	}
+	return written;
+}
+
+// Decodes codes of either run coding
+template<typename Convert>
+static size_t decodeCodes(const CompressedImage& header, const uint8_t* stream, size_t bytes, uint32_t* out, size_t pixelCount, Convert convert) {
+	if (header.runCoding == RunCoding::expGolomb) { return decodeExpGolombRuns(header, stream, bytes, out, pixelCount, convert); }
+	return decodeRuns(header, stream, bytes, out, pixelCount, convert);
+}
+
+// Checks the colour format can be decoded from units of the header's length, building the unit LUT for short units
+static bool prepareUnits(const CompressedImage& header, std::vector<uint32_t>& lut) {
+	if (header.unitLength <= 8) { return makeUnitLUT(header, readPalette(header), lut); }
+	if ((header.unitLength == 16 && (header.colourFormat == CompressedImageColourFormat::colour555 || header.colourFormat == CompressedImageColourFormat::colour565)) ||
+		(header.unitLength == 24 && header.colourFormat == CompressedImageColourFormat::colourFull)) {
+		return true;
+	}
+	std::cerr << "[Error] Colour format does not match unit length " << +header.unitLength << std::endl;
+	return false;
+}
+
+// Calls 'body' with the function that turns the header's units into colours
+template<typename Body>
+static size_t withUnitConverter(const CompressedImage& header, const std::vector<uint32_t>& lut, Body body) {
+	if (header.unitLength <= 8) { return body([&lut](uint32_t unit) { return lut[unit]; }); }
+	if (header.unitLength == 16 && header.colourFormat == CompressedImageColourFormat::colour555) {
+		// 16-bit units hold the little-endian pixel bytes in stream order
+		return body([](uint32_t unit) { return colour555ToARGB((unit & 0xff) << 8 | unit >> 8); });
+	}
+	if (header.unitLength == 16) {
+		return body([](uint32_t unit) { return colour565ToARGB((unit & 0xff) << 8 | unit >> 8); });
+	}
+	// 24-bit units hold the B, G, R bytes in stream order
+	return body([](uint32_t unit) { return makeARGB(unit & 0xff, (unit >> 8) & 0xff, unit >> 16); });
+}
+
+// Decodes one run-length stream into 'out', returning the number of pixels written
+static size_t decodeStream(const CompressedImage& header, const std::vector<uint32_t>& lut, const uint8_t* stream, size_t bytes, uint32_t* out, size_t pixelCount) {
+	return withUnitConverter(header, lut, [&](auto convert) { return decodeCodes(header, stream, bytes, out, pixelCount, convert); });
+}
+
+// Decodes a stream that starts with its RowPredictor byte. The residuals are decoded into 'out' as they are,
+// turned back into units row by row, then converted to colours.
+static size_t decodePredictedStream(const CompressedImage& header, const std::vector<uint32_t>& lut, const uint8_t* stream, size_t bytes, uint32_t* out, size_t pixelCount) {
+	if (bytes == 0 || stream[0] >= rowPredictorCount) { return 0; }
+	RowPredictor predictor = static_cast<RowPredictor>(stream[0]);
+	size_t written = decodeCodes(header, stream + 1, bytes - 1, out, pixelCount, [](uint32_t unit) { return unit; });
+	UnitChannels channels = unitChannels(header.colourFormat, header.unitLength);
+	for (size_t rowStart = 0; rowStart < written; rowStart += header.width) {
+		const uint32_t* above = rowStart == 0 ? nullptr : out + rowStart - header.width;
+		unpredictRow(predictor, channels, above, out + rowStart, std::min<size_t>(header.width, written - rowStart));
+	}
+	return withUnitConverter(header, lut, [&](auto convert) {
+		for (size_t i = 0; i < written; i++) { out[i] = convert(out[i]); }
+		return written;
+	});
+}
+
+// Unwraps a version 3 stripe of 'pixelCount' pixels from its rANS block into 'unpacked' and points stream and bytes
+// at it. A damaged block leaves an empty stream.
+static void unpackStripe(const CompressedImage& header, size_t pixelCount, const uint8_t*& stream, size_t& bytes, std::vector<uint8_t>& unpacked) {
+	// Every code covers at least one pixel, and no code is longer than a unit plus one bit per pixel it covers
+	size_t maxBits = pixelCount * std::max<size_t>(header.packedLength, header.unitLength + 1u);
+	if (!ransDecode(stream, bytes, maxBits / 8 + 2, unpacked)) { unpacked.clear(); }
+	stream = unpacked.data();
+	bytes = unpacked.size();
+}
+
+// Decodes stripes [firstStripe, endStripe) into 'out', which starts at the first row of firstStripe. Stripes that
+// end early are filled with black. Returns the number of damaged stripes.
+static uint32_t decodeStripes(const CompressedImage& header, const std::vector<uint32_t>& lut, uint32_t firstStripe, uint32_t endStripe, uint32_t* out, WorkStealingPool* pool) {
+	uint32_t rows = stripeRows(header);
+	std::atomic<uint32_t> damaged{ 0 };
+	auto decodeStripe = [&](size_t stripe) {
+		uint32_t firstRow = static_cast<uint32_t>(stripe) * rows;
+		uint32_t stripeHeight = std::min<uint32_t>(rows, header.height - firstRow);
+		size_t pixelCount = static_cast<size_t>(header.width) * stripeHeight;
+		uint32_t* stripeOut = out + static_cast<size_t>(firstRow - firstStripe * rows) * header.width;
+		const uint8_t* stream;
+		size_t bytes;
+		stripeStream(header, static_cast<uint32_t>(stripe), stream, bytes);
+		std::vector<uint8_t> unpacked;
+		if (header.version == 3) { unpackStripe(header, pixelCount, stream, bytes, unpacked); }
+		size_t written = header.rowPrediction ? decodePredictedStream(header, lut, stream, bytes, stripeOut, pixelCount) : decodeStream(header, lut, stream, bytes, stripeOut, pixelCount);
+		if (written < pixelCount) {
+			std::fill(stripeOut + written, stripeOut + pixelCount, makeARGB(0, 0, 0));
+			damaged++;
+		}
+	};
+	uint32_t count = endStripe - firstStripe;
+	if (pool != nullptr && pool->size() > 1 && count > 1) {
+		pool->parallelFor(count, [&](size_t i) { decodeStripe(firstStripe + i); });
+	}
+	else {
+		for (uint32_t stripe = firstStripe; stripe < endStripe; stripe++) { decodeStripe(stripe); }
+	}
+	return damaged;
+}
+
+bool decodeRLEI(const uint8_t* data, size_t size, DecodedImage& image, WorkStealingPool* pool) {
+	CompressedImage header;
+	if (!readCompressedImageHeader(data, size, header)) { return false; }
+	std::vector<uint32_t> lut;
+	if (!prepareUnits(header, lut)) { return false; }
+
+	image.width = header.width;
+	image.height = header.height;
+	image.pixels.resize(static_cast<size_t>(header.width) * header.height);
+	if (image.pixels.empty()) { return true; }
+
+	uint32_t stripes = stripeCount(header);
+	uint32_t damaged = decodeStripes(header, lut, 0, stripes, image.pixels.data(), pool);
+	if (damaged == 0) { return true; }
+	if (header.version == 1) { std::cerr << "[Error] Image data ended before the last pixel" << std::endl; }
+	else { std::cerr << "[Error] " << damaged << " of " << stripes << " stripes ended early and were left black" << std::endl; }
+	return false;
+}
+
+bool decodeRLEIRows(const uint8_t* data, size_t size, uint32_t firstRow, uint32_t rowCount, DecodedImage& image) {
+	CompressedImage header;
+	if (!readCompressedImageHeader(data, size, header)) { return false; }
+	if (firstRow > header.height || rowCount > header.height - firstRow) {
+		std::cerr << "[Error] Rows " << firstRow << " to " << firstRow + rowCount << " are outside the image" << std::endl;
+		return false;
+	}
+	std::vector<uint32_t> lut;
+	if (!prepareUnits(header, lut)) { return false; }
+
+	image.width = header.width;
+	image.height = rowCount;
+	image.pixels.clear();
+	if (rowCount == 0 || header.width == 0) { return true; }
+
+	// Decode the covering stripes whole, then keep the rows asked for
+	uint32_t rows = stripeRows(header);
+	uint32_t firstStripe = firstRow / rows;
+	uint32_t endStripe = (firstRow + rowCount - 1) / rows + 1;
+	uint32_t endRow = std::min<uint32_t>(endStripe * rows, header.height);
+	std::vector<uint32_t> stripePixels(static_cast<size_t>(endRow - firstStripe * rows) * header.width);
+	uint32_t damaged = decodeStripes(header, lut, firstStripe, endStripe, stripePixels.data(), nullptr);
+	auto begin = stripePixels.begin() + static_cast<size_t>(firstRow - firstStripe * rows) * header.width;
+	image.pixels.assign(begin, begin + static_cast<size_t>(rowCount) * header.width);
+	if (damaged == 0) { return true; }
+	std::cerr << "[Error] " << damaged << " stripes ended early and were left black" << std::endl;
+	return false;
+}
+
+bool RLEIRowDecoder::open(const uint8_t* data, size_t size) {
+	nextRow = 0;
+	damagedStripes = 0;
+	if (!readCompressedImageHeader(data, size, fileHeader) || !prepareUnits(fileHeader, lut)) {
+		fileHeader = CompressedImage{};
+		return false;
+	}
+	rowsPerStripe = stripeRows(fileHeader);
+	if (fileHeader.rowPrediction) {
+		channels = unitChannels(fileHeader.colourFormat, fileHeader.unitLength);
+		units.resize(fileHeader.width);
+		above.resize(fileHeader.width);
+	}
+	return true;
+}
+
+void RLEIRowDecoder::startStripe(uint32_t stripe) {
+	const uint8_t* stream;
+	size_t bytes;
+	stripeStream(fileHeader, stripe, stream, bytes);
+	if (fileHeader.version == 3) {
+		uint32_t firstRow = stripe * rowsPerStripe;
+		size_t pixelCount = static_cast<size_t>(fileHeader.width) * std::min<uint32_t>(rowsPerStripe, fileHeader.height - firstRow);
+		unpackStripe(fileHeader, pixelCount, stream, bytes, unpacked);
+	}
+	runLeft = 0;
+	streamEnded = false;
+	stripeDamaged = false;
+	if (fileHeader.rowPrediction) {
+		if (bytes == 0 || stream[0] >= rowPredictorCount) {
+			streamEnded = true;
+			bytes = 0;
+		}
+		else {
+			predictor = static_cast<RowPredictor>(stream[0]);
+			stream++;
+			bytes--;
+		}
+	}
+	reader = bitreader(stream, bytes);
+	codesLeft = bytes * 8 / fileHeader.packedLength;
+}
+
+// Reads the stripe's next run into runUnit and runLeft. Returns false at the end of the stream.
+bool RLEIRowDecoder::nextRun() {
+	if (streamEnded) { return false; }
+	if (fileHeader.runCoding == RunCoding::expGolomb) {
+		if (reader.remaining() > fileHeader.unitLength) {
+			runUnit = static_cast<uint32_t>(reader.read(fileHeader.unitLength));
+			if (readExpGolomb(reader, runLeft)) { return true; }
+		}
+	}
+	else if (codesLeft > 0) {
+		codesLeft--;
+		uint32_t packingSpace = fileHeader.packedLength - fileHeader.unitLength;
+		uint64_t code = reader.read(fileHeader.packedLength);
+		runUnit = static_cast<uint32_t>(code >> packingSpace);
+		runLeft = code & ((uint64_t(1) << packingSpace) - 1);
+		return true;
+	}
+	streamEnded = true;
+	return false;
+}
+
+// Fills up to 'count' pixels from the stripe's runs, carrying what is left of the last run over to the next call.
+// Returns the number of pixels written, which is short only when the stream ends.
+template<typename Convert>
+size_t RLEIRowDecoder::takeRuns(uint32_t* out, size_t count, Convert convert) {
+	size_t written = 0;
+	while (written < count) {
+		if (runLeft == 0 && !nextRun()) { break; }
+		size_t run = static_cast<size_t>(std::min<uint64_t>(runLeft, count - written));
+		fill32(out + written, convert(runUnit), run);
+		written += run;
+		runLeft -= run;
+	}
+	return written;
+}
+
+bool RLEIRowDecoder::readRow(ARGB* out) {
+	if (nextRow >= fileHeader.height) { return false; }
+	uint32_t stripeRow = nextRow % rowsPerStripe;
+	if (stripeRow == 0) { startStripe(nextRow / rowsPerStripe); }
+	size_t width = fileHeader.width;
+	size_t written;
+	if (fileHeader.rowPrediction) {
+		// Residuals are turned back into units against the row above, which is kept for the next row
+		written = takeRuns(units.data(), width, [](uint32_t unit) { return unit; });
+		unpredictRow(predictor, channels, stripeRow == 0 ? nullptr : above.data(), units.data(), written);
+		withUnitConverter(fileHeader, lut, [&](auto convert) {
+			for (size_t x = 0; x < written; x++) { out[x] = convert(units[x]); }
+			return written;
+		});
+		units.swap(above);
+	}
+	else {
+		written = withUnitConverter(fileHeader, lut, [&](auto convert) { return takeRuns(out, width, convert); });
+	}
+	if (written < width) {
+		std::fill(out + written, out + width, makeARGB(0, 0, 0));
+		if (!stripeDamaged) { damagedStripes++; }
+		stripeDamaged = true;
+	}
+	nextRow++;
+	return true;
+}
+
+bool decodeRLEIRowByRow(const uint8_t* data, size_t size, const RLEIRowCallback& onRow) {
+	RLEIRowDecoder decoder;
+	if (!decoder.open(data, size)) { return false; }
+	std::vector<ARGB> row(decoder.width());
+	for (uint32_t y = 0; decoder.readRow(row.data()); y++) {
+		if (!onRow(y, row.data())) { break; }
+	}
+	if (decoder.damaged() == 0) { return true; }
+	std::cerr << "[Error] " << decoder.damaged() << " stripes ended early and were left black" << std::endl;
+	return false;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "bmp.h"
+#include "bitvector.h"
+#include "prediction.h"
+#include "cli.h"
+#include "rleiheader.h"
+
+class WorkStealingPool;
+
+// Decoded images share the bitmap reader's layout: 32bpp ARGB, top-down, tightly packed (stride = width)
+using DecodedImage = Image;
+
+// Bits per palette entry for the given palette format, or 0 for noPalette
+int paletteEntryBitWidth(CompressedImagePaletteFormat format);
+
+// Reads and validates the header at the start of an .rlei file. palette and imageData are pointed into 'data'.
+// For version 2 and 3 files the stripe table is checked too.
+bool readCompressedImageHeader(const uint8_t* data, size_t size, CompressedImage& header);
+
+// Version 2 files split the image into stripes of stripeHeight rows (the last may be shorter). Image data starts
+// with a table of stripeCount + 1 little-endian uint32 byte offsets, relative to the end of the table, and each
+// stripe is a separate run-length stream starting on a byte boundary, so any stripe can be decoded on its own.
+// Version 3 files have the same layout, but each stripe's stream is wrapped in an rANS block (see rans.h).
+// With rowPrediction set, each stripe's stream starts with a byte naming the predictor it was coded against
+// (see prediction.h).
+// Version 1 files count as a single stripe covering the whole image.
+uint32_t stripeCount(const CompressedImage& header);
+// Rows per stripe
+uint32_t stripeRows(const CompressedImage& header);
+// The stored bytes of one stripe (the rANS block, for version 3), from a header that passed readCompressedImageHeader
+void stripeStream(const CompressedImage& header, uint32_t stripe, const uint8_t*& stream, size_t& bytes);
+
+// Decodes a complete in-memory .rlei file into 32bpp ARGB pixels. The stripes of version 2 and 3 files are decoded on
+// 'pool' when one is given; a damaged stripe is left black without affecting the others.
+bool decodeRLEI(const uint8_t* data, size_t size, DecodedImage& image, WorkStealingPool* pool = nullptr);
+
+// Decodes rows [firstRow, firstRow + rowCount) only, into an image that is rowCount rows high. Striped files
+// only decode the stripes those rows fall in; version 1 files are decoded whole.
+bool decodeRLEIRows(const uint8_t* data, size_t size, uint32_t firstRow, uint32_t rowCount, DecodedImage& image);
+
+// Pull decoder that hands out one row at a time, top to bottom, into the caller's buffer, so an image can be shown
+// or scaled without decoding it whole. Only the run in progress and, for predicted files, the row above are kept
+// between rows; version 3 stripes are unpacked from rANS one at a time. 'data' must outlive the decoder.
+class RLEIRowDecoder {
+private:
+	CompressedImage fileHeader{};
+	std::vector<uint32_t> lut;
+	uint32_t rowsPerStripe = 1;
+	uint32_t nextRow = 0;
+	uint32_t damagedStripes = 0;
+
+	// The stripe being read
+	std::vector<uint8_t> unpacked;	// the stripe's run-length stream, for version 3
+	bitreader reader = bitreader(nullptr, 0);
+	size_t codesLeft = 0;	// fixed-width codes not read yet
+	bool streamEnded = false;
+	bool stripeDamaged = false;
+	uint32_t runUnit = 0;
+	uint64_t runLeft = 0;
+
+	// Predicted files only
+	RowPredictor predictor = RowPredictor::none;
+	UnitChannels channels;
+	std::vector<uint32_t> units;
+	std::vector<uint32_t> above;
+
+	void startStripe(uint32_t stripe);
+	bool nextRun();
+	template<typename Convert>
+	size_t takeRuns(uint32_t* out, size_t count, Convert convert);
+public:
+	// Reads the header and palette. Returns false, with the reason on stderr, if the file cannot be decoded.
+	bool open(const uint8_t* data, size_t size);
+	const CompressedImage& header() const { return fileHeader; }
+	uint32_t width() const { return fileHeader.width; }
+	uint32_t height() const { return fileHeader.height; }
+	// The row readRow fills next
+	uint32_t row() const { return nextRow; }
+
+	// Decodes the next row into 'out', which holds at least width() pixels. Returns false once every row has been
+	// read. Pixels past the end of a damaged stripe are black, as decodeRLEI leaves them.
+	bool readRow(ARGB* out);
+	// The stripes read so far that ended early
+	uint32_t damaged() const { return damagedStripes; }
+};
+
+// Called with each row from the top, as 'y' and width ARGB pixels valid for the call. Returning false stops decoding.
+using RLEIRowCallback = std::function<bool(uint32_t y, const ARGB* row)>;
+// Decodes the file one row at a time through RLEIRowDecoder, handing each row to 'onRow'. Returns false if the file
+// cannot be decoded or has damaged stripes, whose rows are still handed over with the missing pixels black.
+bool decodeRLEIRowByRow(const uint8_t* data, size_t size, const RLEIRowCallback& onRow);
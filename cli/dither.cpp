@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "threadpool.h"
+#include "dither.h"
+
+namespace {
+	// How a direct low-bit format quantises: each of 'channels' values from 0 to 'range' becomes a level from 0
+	// to 'maxLevel', shifted into place in the unit
+	struct LowBitLayout {
+		int channels = 0;	// 3 for R, G and B, or 1 for the R + G + B sum the greyscale formats use
+		uint32_t maxLevel = 0;
+		uint32_t range = 0;
+		int shifts[3] = {};
+	};
+
+	bool lowBitLayout(CompressedImageColourFormat format, LowBitLayout& layout) {
+		switch (format) {
+		case CompressedImageColourFormat::packedColour3Bit: layout = { 3, 1, 255, { 2, 1, 0 } }; return true;
+		case CompressedImageColourFormat::packedColour6Bit: layout = { 3, 3, 255, { 4, 2, 0 } }; return true;
+		case CompressedImageColourFormat::packedGreyscale1Bit: layout = { 1, 1, 765, { 0 } }; return true;
+		case CompressedImageColourFormat::packedGreyscale2Bit: layout = { 1, 3, 765, { 0 } }; return true;
+		case CompressedImageColourFormat::packedGreyscale3Bit: layout = { 1, 7, 765, { 0 } }; return true;
+		case CompressedImageColourFormat::packedGreyscale4Bit: layout = { 1, 15, 765, { 0 } }; return true;
+		default: return false;
+		}
+	}
+
+	// The value the decoder shows for a level. Greyscale levels come back as three equal channels.
+	int32_t levelValue(const LowBitLayout& layout, uint32_t level) {
+		int32_t channel = static_cast<int32_t>(level * 255 / layout.maxLevel);
+		return layout.channels == 1 ? 3 * channel : channel;
+	}
+
+	// Bayer matrix entry: the low bit of each coordinate picks the top two bits of the threshold, and so on down
+	constexpr uint32_t bayer8(uint32_t x, uint32_t y) {
+		uint32_t threshold = 0;
+		for (int bit = 0; bit < 3; bit++) {
+			uint32_t xBit = (x >> bit) & 1, yBit = (y >> bit) & 1;
+			threshold = (threshold << 2) | ((xBit ^ yBit) << 1) | yBit;
+		}
+		return threshold;
+	}
+
+	// floor(value * maxLevel / range + (threshold + 0.5) / 64). A threshold of 31.5 would be plain rounding.
+	constexpr uint32_t orderedLevel(uint32_t value, uint32_t maxLevel, uint32_t range, uint32_t threshold) {
+		return (128 * maxLevel * value + (2 * threshold + 1) * range) / (128 * range);
+	}
+
+	// Levels for every value at every threshold, so a pixel costs the same table lookups as an undithered one
+	struct OrderedTables {
+		uint8_t thresholds[8][8];	// [y][x]
+		uint8_t colour[2][64][256];	// 1 and 2 bits per channel
+		uint8_t grey[4][64][766];	// 1 to 4 bits, indexed by R + G + B
+
+		OrderedTables() {
+			for (uint32_t y = 0; y < 8; y++) {
+				for (uint32_t x = 0; x < 8; x++) { thresholds[y][x] = static_cast<uint8_t>(bayer8(x, y)); }
+			}
+			for (uint32_t threshold = 0; threshold < 64; threshold++) {
+				for (uint32_t v = 0; v < 256; v++) {
+					colour[0][threshold][v] = static_cast<uint8_t>(orderedLevel(v, 1, 255, threshold));
+					colour[1][threshold][v] = static_cast<uint8_t>(orderedLevel(v, 3, 255, threshold));
+				}
+				for (uint32_t bits = 1; bits <= 4; bits++) {
+					for (uint32_t sum = 0; sum < 766; sum++) { grey[bits - 1][threshold][sum] = static_cast<uint8_t>(orderedLevel(sum, (1 << bits) - 1, 765, threshold)); }
+				}
+			}
+		}
+	};
+
+	const OrderedTables& orderedTables() {
+		static const OrderedTables instance;
+		return instance;
+	}
+
+	inline uint32_t red(ARGB colour) { return (colour >> 16) & 0xff; }
+	inline uint32_t green(ARGB colour) { return (colour >> 8) & 0xff; }
+	inline uint32_t blue(ARGB colour) { return colour & 0xff; }
+
+	// Nearest level and the value it decodes to, for every value a channel can be pushed to
+	struct DiffusionTables {
+		std::vector<uint8_t> levels;
+		std::vector<int32_t> values;
+
+		explicit DiffusionTables(const LowBitLayout& layout) : levels(layout.range + 1), values(layout.range + 1) {
+			for (uint32_t v = 0; v <= layout.range; v++) {
+				levels[v] = static_cast<uint8_t>((2 * v * layout.maxLevel + layout.range) / (2 * layout.range));
+				values[v] = levelValue(layout, levels[v]);
+			}
+		}
+	};
+
+	// The value each channel of every unit decodes to
+	struct UnitValues {
+		int32_t values[64][3] = {};
+
+		explicit UnitValues(const LowBitLayout& layout) {
+			for (uint32_t unit = 0; unit < 64; unit++) {
+				for (int c = 0; c < layout.channels; c++) { values[unit][c] = levelValue(layout, (unit >> layout.shifts[c]) & layout.maxLevel); }
+			}
+		}
+	};
+
+	template<int channels>
+	bool withinTolerance(const int32_t* values, const int32_t* unitValues, int32_t tolerance) {
+		for (int c = 0; c < channels; c++) {
+			int32_t difference = values[c] - unitValues[c];
+			if (difference > tolerance || difference < -tolerance) { return false; }
+		}
+		return true;
+	}
+
+	// Dithers pixels [first, end) of a row. 'current' holds the error pushed down from the row above, which is
+	// cleared as it is read, and 'below' collects the error for the next row; 'carried' is what goes right.
+	// 'previous' is the unit to the left, or -1, for keeping runs when runTolerance is non-zero.
+	template<int channels>
+	void diffuseSpan(const LowBitLayout& layout, const DiffusionTables& tables, const UnitValues& unitValues, int32_t runTolerance, const ARGB* row, uint32_t first, uint32_t end, int32_t* current, int32_t* below, int32_t* carried, int32_t& previous, uint8_t* out) {
+		const int32_t range = static_cast<int32_t>(layout.range);
+		for (uint32_t x = first; x < end; x++) {
+			int32_t wanted[3];
+			if constexpr (channels == 1) { wanted[0] = static_cast<int32_t>(red(row[x]) + green(row[x]) + blue(row[x])); }
+			else {
+				wanted[0] = static_cast<int32_t>(red(row[x]));
+				wanted[1] = static_cast<int32_t>(green(row[x]));
+				wanted[2] = static_cast<int32_t>(blue(row[x]));
+			}
+			for (int c = 0; c < channels; c++) {
+				int32_t& fromAbove = current[static_cast<size_t>(x) * channels + c];
+				wanted[c] = std::clamp(wanted[c] + ((fromAbove + carried[c] + 8) >> 4), 0, range);
+				fromAbove = 0;
+			}
+			uint32_t unit = 0;
+			const int32_t* values;
+			if (runTolerance > 0 && previous >= 0 && withinTolerance<channels>(wanted, unitValues.values[previous], runTolerance)) {
+				unit = static_cast<uint32_t>(previous);
+				values = unitValues.values[previous];
+			}
+			else {
+				for (int c = 0; c < channels; c++) { unit |= static_cast<uint32_t>(tables.levels[wanted[c]]) << layout.shifts[c]; }
+				values = unitValues.values[unit];
+			}
+			for (int c = 0; c < channels; c++) {
+				int32_t error = wanted[c] - values[c];
+				carried[c] = 7 * error;
+				int32_t* next = below + static_cast<size_t>(x) * channels + c;
+				next[-channels] += 3 * error;
+				next[0] += 5 * error;
+				next[channels] += error;
+			}
+			out[x] = static_cast<uint8_t>(unit);
+			previous = static_cast<int32_t>(unit);
+		}
+	}
+
+	// Everything one Floyd-Steinberg pass keeps. The error pushed down to the next row is kept in 16ths, with a
+	// pixel of padding at each end, in two slots: row y reads slot y % 2 and clears what it reads, and row y + 1
+	// refills it behind row y, which it never overtakes.
+	struct Diffusion {
+		LowBitLayout layout;
+		DiffusionTables tables;
+		UnitValues unitValues;
+		int32_t tolerance;
+		uint32_t width;
+		size_t errorStride;
+		std::vector<int32_t> errorRows;
+
+		Diffusion(const LowBitLayout& layout, uint32_t width, uint32_t runTolerance)
+			: layout(layout), tables(layout), unitValues(layout), tolerance(static_cast<int32_t>(runTolerance) * (layout.channels == 1 ? 3 : 1)),
+			width(width), errorStride((static_cast<size_t>(width) + 2) * layout.channels), errorRows(errorStride * 2, 0) {}
+
+		// Pixels [first, end) of row y; 'carried' and 'previous' go from one span of the row to the next
+		void span(uint32_t y, const ARGB* row, uint32_t first, uint32_t end, int32_t* carried, int32_t& previous, uint8_t* out) {
+			int32_t* current = errorRows.data() + (y % 2) * errorStride + layout.channels;
+			int32_t* below = errorRows.data() + ((y + 1) % 2) * errorStride + layout.channels;
+			if (layout.channels == 1) { diffuseSpan<1>(layout, tables, unitValues, tolerance, row, first, end, current, below, carried, previous, out); }
+			else { diffuseSpan<3>(layout, tables, unitValues, tolerance, row, first, end, current, below, carried, previous, out); }
+		}
+	};
+
+	// Pixels a row dithers between telling the row below how far it has got
+	constexpr uint32_t wavefrontChunk = 64;
+
+	// Per row, padded to a cache line so neighbouring rows' threads do not share one
+	struct alignas(64) RowProgress {
+		std::atomic<uint32_t> pixels{ 0 };
+	};
+
+	void waitForProgress(const RowProgress& progress, uint32_t pixels) {
+		uint32_t attempt = 0;
+		while (progress.pixels.load(std::memory_order_acquire) < pixels) {
+			if (++attempt < 1024) { std::this_thread::yield(); }
+			else { std::this_thread::sleep_for(std::chrono::microseconds(50)); }
+		}
+	}
+}
+
+struct FloydSteinbergRows::State {
+	Diffusion diffusion;
+	State(const LowBitLayout& layout, uint32_t width, uint32_t runTolerance) : diffusion(layout, width, runTolerance) {}
+};
+
+bool parseDitherMethod(const std::string& name, DitherMethod& method) {
+	if (name == "none") { method = DitherMethod::none; }
+	else if (name == "ordered") { method = DitherMethod::ordered; }
+	else if (name == "floyd-steinberg") { method = DitherMethod::floydSteinberg; }
+	else { return false; }
+	return true;
+}
+
+bool ditherable(CompressedImageColourFormat format) {
+	LowBitLayout layout;
+	return lowBitLayout(format, layout);
+}
+
+void ditherRowOrdered(CompressedImageColourFormat format, const ARGB* row, uint32_t width, uint32_t y, uint8_t* out) {
+	const OrderedTables& t = orderedTables();
+	const uint8_t* thresholds = t.thresholds[y & 7];
+	switch (format) {
+	case CompressedImageColourFormat::packedColour3Bit:
+	case CompressedImageColourFormat::packedColour6Bit: {
+		bool sixBit = format == CompressedImageColourFormat::packedColour6Bit;
+		int bits = sixBit ? 2 : 1;
+		const auto& levels = t.colour[sixBit ? 1 : 0];
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t* level = levels[thresholds[x & 7]];
+			out[x] = static_cast<uint8_t>(level[red(row[x])] << (2 * bits) | level[green(row[x])] << bits | level[blue(row[x])]);
+		}
+		break;
+	}
+	default: {
+		LowBitLayout layout;
+		if (!lowBitLayout(format, layout)) { return; }
+		const auto& levels = t.grey[std::bit_width(layout.maxLevel) - 1];
+		for (uint32_t x = 0; x < width; x++) { out[x] = levels[thresholds[x & 7]][red(row[x]) + green(row[x]) + blue(row[x])]; }
+		break;
+	}
+	}
+}
+
+void keepRuns(CompressedImageColourFormat format, uint32_t runTolerance, const ARGB* row, uint32_t width, uint8_t* units) {
+	LowBitLayout layout;
+	if (runTolerance == 0 || !lowBitLayout(format, layout)) { return; }
+	UnitValues unitValues(layout);
+	int32_t tolerance = static_cast<int32_t>(runTolerance) * (layout.channels == 1 ? 3 : 1);
+	for (uint32_t x = 1; x < width; x++) {
+		if (units[x] == units[x - 1]) { continue; }
+		const int32_t* runValues = unitValues.values[units[x - 1]];
+		bool keep;
+		if (layout.channels == 1) {
+			int32_t sum = static_cast<int32_t>(red(row[x]) + green(row[x]) + blue(row[x]));
+			keep = withinTolerance<1>(&sum, runValues, tolerance);
+		}
+		else {
+			int32_t values[3] = { static_cast<int32_t>(red(row[x])), static_cast<int32_t>(green(row[x])), static_cast<int32_t>(blue(row[x])) };
+			keep = withinTolerance<3>(values, runValues, tolerance);
+		}
+		if (keep) { units[x] = units[x - 1]; }
+	}
+}
+
+FloydSteinbergRows::FloydSteinbergRows(CompressedImageColourFormat format, uint32_t width, uint32_t runTolerance) {
+	LowBitLayout layout;
+	if (lowBitLayout(format, layout)) { state = std::make_unique<State>(layout, width, runTolerance); }
+}
+
+FloydSteinbergRows::~FloydSteinbergRows() = default;
+
+void FloydSteinbergRows::ditherRow(const ARGB* row, uint8_t* out) {
+	if (!state) { return; }
+	int32_t carried[3] = {};
+	int32_t previous = -1;
+	state->diffusion.span(nextRow++, row, 0, state->diffusion.width, carried, previous, out);
+}
+
+void ditherFloydSteinberg(CompressedImageColourFormat format, uint32_t width, uint32_t height, uint32_t runTolerance, const DitherRowSource& rowSource, WorkStealingPool* pool, uint8_t* units) {
+	LowBitLayout layout;
+	if (!lowBitLayout(format, layout) || width == 0 || height == 0) { return; }
+	Diffusion diffusion(layout, width, runTolerance);
+	size_t lanes = pool != nullptr && pool->size() > 1 ? std::min<size_t>(pool->size(), height) : 1;
+	std::unique_ptr<RowProgress[]> progress(new RowProgress[height]);
+
+	auto ditherRow = [&](uint32_t y, ARGB* rowBuffer) {
+		const ARGB* row = rowSource(y, rowBuffer);
+		uint8_t* out = units + static_cast<size_t>(y) * width;
+		int32_t carried[3] = {};	// pushed right, in 16ths
+		int32_t previous = -1;
+		for (uint32_t chunkStart = 0; chunkStart < width; chunkStart += wavefrontChunk) {
+			uint32_t chunkEnd = std::min(chunkStart + wavefrontChunk, width);
+			// Every pixel takes error from up to one pixel to its right in the row above
+			if (y > 0) { waitForProgress(progress[y - 1], std::min(chunkEnd + 1, width)); }
+			diffusion.span(y, row, chunkStart, chunkEnd, carried, previous, out);
+			progress[y].pixels.store(chunkEnd, std::memory_order_release);
+		}
+	};
+	// Lane k takes rows k, k + lanes, ...; every lane has to be running at once, hence one task per lane
+	auto runLane = [&](size_t lane) {
+		ScratchVector<ARGB> rowBuffer(width);
+		for (uint32_t y = static_cast<uint32_t>(lane); y < height; y += static_cast<uint32_t>(lanes)) { ditherRow(y, rowBuffer.data()); }
+	};
+	if (lanes == 1) { runLane(0); }
+	else { pool->parallelFor(lanes, runLane); }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include "colorconverter.h"
+#include "cli.h"
+
+class WorkStealingPool;
+
+// Dithering for the direct low-bit formats (pc3, pc6 and pg1 to pg4), which otherwise round every pixel to the
+// nearest level on its own
+enum class DitherMethod {
+	none,
+	ordered,	// 8x8 Bayer threshold matrix; every pixel is independent, so rows are dithered as they are encoded
+	floydSteinberg	// error diffusion; each row depends on the one above, so the whole image is dithered first
+};
+
+// Parses "none", "ordered" or "floyd-steinberg"
+bool parseDitherMethod(const std::string& name, DitherMethod& method);
+// Whether dithering applies to the colour format
+bool ditherable(CompressedImageColourFormat format);
+
+// One row to units of a ditherable format with ordered dithering. 'y' picks the row of the threshold matrix.
+void ditherRowOrdered(CompressedImageColourFormat format, const ARGB* row, uint32_t width, uint32_t y, uint8_t* out);
+
+// Run-friendly quantisation: a pixel takes the same unit as the pixel to its left whenever that unit's colour is
+// within 'runTolerance' of the pixel on every channel (0 to 255), so runs are not broken by small differences.
+// Runs are only extended within a row, so rows and bands can still be quantised independently.
+// This rewrites a row of 'units' already quantised from 'row'.
+void keepRuns(CompressedImageColourFormat format, uint32_t runTolerance, const ARGB* row, uint32_t width, uint8_t* units);
+
+// Row y of the image being dithered, as rowPixels gives it
+using DitherRowSource = std::function<const ARGB*(uint32_t y, ARGB* buffer)>;
+// Dithers a whole image with Floyd-Steinberg error diffusion into 'units' (width * height, row by row). With a
+// pool the rows are dealt out to the threads and run as a wavefront, each row keeping a little behind the one
+// above, which gives exactly the result of a serial pass. The pool must have nothing else to do meanwhile.
+// A non-zero runTolerance keeps runs as keepRuns does, comparing against the pixel plus the error diffused into
+// it, so the error of extending a run is spread over the pixels around it like any other.
+void ditherFloydSteinberg(CompressedImageColourFormat format, uint32_t width, uint32_t height, uint32_t runTolerance, const DitherRowSource& rowSource, WorkStealingPool* pool, uint8_t* units);
+
+// Floyd-Steinberg for rows handed over one at a time from the top, keeping only the error for the next row, so
+// an image can be dithered as it is streamed. Gives the same units as ditherFloydSteinberg.
+class FloydSteinbergRows {
+private:
+	struct State;
+	std::unique_ptr<State> state;
+	uint32_t nextRow = 0;
+public:
+	FloydSteinbergRows(CompressedImageColourFormat format, uint32_t width, uint32_t runTolerance);
+	~FloydSteinbergRows();
+	FloydSteinbergRows(const FloydSteinbergRows&) = delete;
+	FloydSteinbergRows& operator=(const FloydSteinbergRows&) = delete;
+
+	// Dithers the next row into 'out'
+	void ditherRow(const ARGB* row, uint8_t* out);
+};
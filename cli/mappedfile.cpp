@@ -0,0 +1,93 @@
+#include <iostream>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mappedfile.h"
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+	close();
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		std::cerr << "[Error] Failed to open file: " << path << std::endl;
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		std::cerr << "[Error] File is empty: " << path << std::endl;
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mappingObject = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingObject == nullptr) {
+		std::cerr << "[Error] Failed to map file: " << path << std::endl;
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mappingObject, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		std::cerr << "[Error] Failed to map file: " << path << std::endl;
+		CloseHandle(mappingObject);
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mappingObject;
+	mapping = static_cast<const uint8_t*>(view);
+	mappingSize = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapping != nullptr) { UnmapViewOfFile(mapping); }
+	if (mappingHandle != nullptr) { CloseHandle(mappingHandle); }
+	if (fileHandle != nullptr) { CloseHandle(fileHandle); }
+	mapping = nullptr;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+	mappingSize = 0;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+	close();
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		std::cerr << "[Error] Failed to open file: " << path << std::endl;
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+		std::cerr << "[Error] File is empty: " << path << std::endl;
+		::close(file);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	if (view == MAP_FAILED) {
+		std::cerr << "[Error] Failed to map file: " << path << std::endl;
+		::close(file);
+		return false;
+	}
+	// Every page is going to be read, but bottom-up bitmaps are walked back to front
+	madvise(view, static_cast<size_t>(fileStat.st_size), MADV_WILLNEED);
+	fileDescriptor = file;
+	mapping = static_cast<const uint8_t*>(view);
+	mappingSize = static_cast<size_t>(fileStat.st_size);
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapping != nullptr) { munmap(const_cast<uint8_t*>(mapping), mappingSize); }
+	if (fileDescriptor >= 0) { ::close(fileDescriptor); }
+	mapping = nullptr;
+	fileDescriptor = -1;
+	mappingSize = 0;
+}
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping is released when the object is destroyed.
+class MappedFile {
+private:
+	const uint8_t* mapping = nullptr;
+	size_t mappingSize = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+	const uint8_t* data() const { return mapping; }
+	size_t size() const { return mappingSize; }
+	// Reads a byte from every page so that the disk reads happen now rather than when the data is first used
+	void prefault() const {
+		volatile uint8_t sink = 0;
+		for (size_t i = 0; i < mappingSize; i += 4096) { sink = sink ^ mapping[i]; }
+	}
+};
@@ -0,0 +1,53 @@
+#include <bit>
+#include "paletteindexmap.h"
+
+PaletteIndexMap::PaletteIndexMap(const std::vector<ARGB>& palette) : palette(palette.begin(), palette.end()) {
+	if (palette.size() > 256) { this->palette.resize(256); }
+
+	// Try the dense table first; any two entries sharing a 555 reduction rule it out
+	dense.assign(32768, 0);
+	ScratchVector<uint8_t> taken(32768, 0);
+	for (size_t i = 0; i < this->palette.size(); i++) {
+		uint32_t key = reduce555(this->palette[i]);
+		if (taken[key]) {
+			ScratchVector<uint8_t>().swap(dense);
+			break;
+		}
+		taken[key] = true;
+		dense[key] = static_cast<uint8_t>(i);
+	}
+	if (!dense.empty()) { return; }
+
+	size_t capacity = 16;
+	while (capacity < this->palette.size() * 2) { capacity *= 2; }
+	slots.assign(capacity, Slot{ 0, emptySlot });
+	shift = 32 - static_cast<uint32_t>(std::countr_zero(capacity));
+	size_t mask = capacity - 1;
+	for (size_t i = 0; i < this->palette.size(); i++) {
+		ARGB colour = this->palette[i];
+		size_t slot = slotFor(colour);
+		while (slots[slot].index != emptySlot && slots[slot].colour != colour) { slot = (slot + 1) & mask; }
+		// Duplicate entries keep the first index
+		if (slots[slot].index == emptySlot) { slots[slot] = Slot{ colour, static_cast<uint32_t>(i) }; }
+	}
+}
+
+void PaletteIndexMap::indexRow(const ARGB* row, uint32_t width, uint8_t* indices) const {
+	if (!dense.empty()) {
+		const uint8_t* table = dense.data();
+		for (uint32_t x = 0; x < width; x++) { indices[x] = table[reduce555(row[x])]; }
+		return;
+	}
+	// Runs of one colour are common, so only probe when the colour changes
+	ARGB lastColour = 0;
+	uint8_t lastIndex = 0;
+	bool haveLast = false;
+	for (uint32_t x = 0; x < width; x++) {
+		if (!haveLast || row[x] != lastColour) {
+			lastColour = row[x];
+			lastIndex = static_cast<uint8_t>(hashedIndex(lastColour));
+			haveLast = true;
+		}
+		indices[x] = lastIndex;
+	}
+}
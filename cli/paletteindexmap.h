@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "colorconverter.h"
+#include "arena.h"
+
+// Colour -> palette index lookup for palettes of up to 256 entries, built once per palette.
+// When the 555 reductions of the palette colours are all distinct, lookups go through a dense 32K table of
+// indices keyed by that reduction (32KB, stays in cache). Otherwise a small flat hash over the exact colours is used.
+class PaletteIndexMap {
+private:
+	struct Slot {
+		ARGB colour;
+		uint32_t index;	// emptySlot when unused
+	};
+	static constexpr uint32_t emptySlot = UINT32_MAX;
+
+	ScratchVector<ARGB> palette;
+	ScratchVector<uint8_t> dense;
+	ScratchVector<Slot> slots;
+	uint32_t shift = 32;
+
+	static uint32_t reduce555(ARGB colour) { return (colour >> 9 & 0x7c00) | (colour >> 6 & 0x03e0) | (colour >> 3 & 0x001f); }
+	size_t slotFor(ARGB colour) const { return static_cast<uint32_t>(colour * 2654435761u) >> shift; }
+	uint32_t hashedIndex(ARGB colour) const {
+		size_t mask = slots.size() - 1;
+		for (size_t i = slotFor(colour); slots[i].index != emptySlot; i = (i + 1) & mask) {
+			if (slots[i].colour == colour) { return slots[i].index; }
+		}
+		return emptySlot;
+	}
+public:
+	explicit PaletteIndexMap(const std::vector<ARGB>& palette);
+
+	size_t size() const { return palette.size(); }
+	bool usesDenseTable() const { return !dense.empty(); }
+	// Looks up any colour. Returns false if it is not in the palette.
+	bool find(ARGB colour, uint32_t& index) const {
+		if (!dense.empty()) {
+			index = dense[reduce555(colour)];
+			return index < palette.size() && palette[index] == colour;
+		}
+		index = hashedIndex(colour);
+		return index != emptySlot;
+	}
+	// Index of a colour already known to be in the palette
+	uint32_t indexOf(ARGB colour) const {
+		return dense.empty() ? hashedIndex(colour) : dense[reduce555(colour)];
+	}
+	// Indexes a whole row in which every colour is in the palette
+	void indexRow(const ARGB* row, uint32_t width, uint8_t* indices) const;
+};
@@ -0,0 +1,93 @@
+#include <string.h>
+#include "prediction.h"
+
+UnitChannels unitChannels(CompressedImageColourFormat colourFormat, int unitLength) {
+	UnitChannels channels;
+	auto addChannel = [&channels](int shift, int bits) { channels.masks[channels.count++] = ((uint32_t(1) << bits) - 1) << shift; };
+	switch (colourFormat) {
+	case CompressedImageColourFormat::colour555:
+		channels.swapBytes = true;
+		addChannel(10, 5); addChannel(5, 5); addChannel(0, 5);
+		break;
+	case CompressedImageColourFormat::colour565:
+		channels.swapBytes = true;
+		addChannel(11, 5); addChannel(5, 6); addChannel(0, 5);
+		break;
+	case CompressedImageColourFormat::colourFull: addChannel(16, 8); addChannel(8, 8); addChannel(0, 8); break;
+	case CompressedImageColourFormat::packedColour3Bit: addChannel(2, 1); addChannel(1, 1); addChannel(0, 1); break;
+	case CompressedImageColourFormat::packedColour6Bit: addChannel(4, 2); addChannel(2, 2); addChannel(0, 2); break;
+	// Grey levels, and palette indices, which only "up" and "left" really suit
+	default: channels.masks[channels.count++] = static_cast<uint32_t>((uint64_t(1) << unitLength) - 1); break;
+	}
+	channels.otherBits = ~0u;
+	for (int i = 0; i < channels.count; i++) {
+		uint32_t top = channels.masks[i] & ~(channels.masks[i] >> 1);
+		channels.topBits |= top;
+		channels.lowBits |= channels.masks[i] & ~top;
+		channels.otherBits &= ~channels.masks[i];
+	}
+	return channels;
+}
+
+static uint32_t swap16(uint32_t v) { return (v & 0xff) << 8 | (v >> 8 & 0xff); }
+
+// Channel by channel modulo the channel's width, all channels at once: the top bit of each channel is handled
+// separately, so no carry or borrow crosses into the next channel
+static uint32_t subtractChannels(const UnitChannels& channels, uint32_t value, uint32_t prediction) {
+	uint32_t difference = ((value | channels.topBits) - (prediction & channels.lowBits)) ^ ((value ^ ~prediction) & channels.topBits);
+	return (difference & ~channels.otherBits) | (value & channels.otherBits);
+}
+static uint32_t addChannels(const UnitChannels& channels, uint32_t residual, uint32_t prediction) {
+	uint32_t sum = ((residual & channels.lowBits) + (prediction & channels.lowBits)) ^ ((residual ^ prediction) & channels.topBits);
+	return sum | (residual & channels.otherBits);
+}
+
+static uint32_t distance(int64_t a, int64_t b) { return static_cast<uint32_t>(a > b ? a - b : b - a); }
+
+static uint32_t paethPrediction(const UnitChannels& channels, uint32_t left, uint32_t above, uint32_t aboveLeft) {
+	uint32_t prediction = 0;
+	for (int i = 0; i < channels.count; i++) {
+		uint32_t mask = channels.masks[i];
+		int64_t a = left & mask, b = above & mask, c = aboveLeft & mask;
+		int64_t estimate = a + b - c;
+		uint32_t da = distance(estimate, a), db = distance(estimate, b), dc = distance(estimate, c);
+		prediction |= static_cast<uint32_t>(da <= db && da <= dc ? a : db <= dc ? b : c);
+	}
+	return prediction;
+}
+
+// Residuals from units, or with 'inverse' units from residuals. 'in' and 'out' may be the same row.
+template<RowPredictor predictor, bool inverse>
+static void transformRow(const UnitChannels& channels, const uint32_t* above, const uint32_t* in, uint32_t* out, size_t width) {
+	uint32_t left = 0, aboveLeft = 0;
+	for (size_t x = 0; x < width; x++) {
+		uint32_t value = channels.swapBytes ? swap16(in[x]) : in[x];
+		uint32_t up = above == nullptr ? 0 : channels.swapBytes ? swap16(above[x]) : above[x];
+		uint32_t prediction;
+		if constexpr (predictor == RowPredictor::left) { prediction = left; }
+		else if constexpr (predictor == RowPredictor::up) { prediction = up; }
+		else { prediction = paethPrediction(channels, left, up, aboveLeft); }
+		uint32_t result = inverse ? addChannels(channels, value, prediction) : subtractChannels(channels, value, prediction);
+		out[x] = channels.swapBytes ? swap16(result) : result;
+		left = inverse ? result : value;
+		aboveLeft = up;
+	}
+}
+
+void predictRow(RowPredictor predictor, const UnitChannels& channels, const uint32_t* above, const uint32_t* row, uint32_t* residuals, size_t width) {
+	switch (predictor) {
+	case RowPredictor::left: transformRow<RowPredictor::left, false>(channels, above, row, residuals, width); break;
+	case RowPredictor::up: transformRow<RowPredictor::up, false>(channels, above, row, residuals, width); break;
+	case RowPredictor::paeth: transformRow<RowPredictor::paeth, false>(channels, above, row, residuals, width); break;
+	default: memcpy(residuals, row, width * sizeof(uint32_t)); break;
+	}
+}
+
+void unpredictRow(RowPredictor predictor, const UnitChannels& channels, const uint32_t* above, uint32_t* row, size_t width) {
+	switch (predictor) {
+	case RowPredictor::left: transformRow<RowPredictor::left, true>(channels, above, row, row, width); break;
+	case RowPredictor::up: transformRow<RowPredictor::up, true>(channels, above, row, row, width); break;
+	case RowPredictor::paeth: transformRow<RowPredictor::paeth, true>(channels, above, row, row, width); break;
+	default: break;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "cli.h"
+
+// Predictors a stripe's rows can be coded against, chosen per stripe by the encoder. A predicted stripe's stream
+// starts with one byte naming its predictor, followed by the run-length codes of the residuals: each unit minus
+// its prediction, channel by channel, modulo the channel's width. Rows above the stripe are not used, so the
+// first row of every stripe is predicted from a row of zeros.
+enum class RowPredictor : uint8_t {
+	none = 0,
+	left = 1,	// the unit to the left
+	up = 2,	// the unit above
+	paeth = 3,	// per channel, whichever of left, above and above-left is closest to left + above - above-left
+};
+constexpr uint8_t rowPredictorCount = 4;
+
+// The colour channels of a unit, which are predicted separately
+struct UnitChannels {
+	uint32_t masks[3] = {};
+	int count = 0;
+	uint32_t topBits = 0;	// the highest bit of each channel
+	uint32_t lowBits = 0;	// the other bits of each channel
+	uint32_t otherBits = 0;	// bits outside every channel, stored unchanged
+	bool swapBytes = false;	// 16-bit units hold the pixel's bytes in memory order, so they are swapped around the arithmetic
+};
+UnitChannels unitChannels(CompressedImageColourFormat colourFormat, int unitLength);
+
+// Writes the residuals of one row of units. 'above' is the previous row, or nullptr for the first row of a stripe.
+void predictRow(RowPredictor predictor, const UnitChannels& channels, const uint32_t* above, const uint32_t* row, uint32_t* residuals, size_t width);
+// Turns a row of residuals back into units, in place
+void unpredictRow(RowPredictor predictor, const UnitChannels& channels, const uint32_t* above, uint32_t* row, size_t width);
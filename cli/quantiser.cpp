@@ -0,0 +1,197 @@
+#include <algorithm>
+#include "quantiser.h"
+
+bool parseQuantiserMethod(const std::string& name, QuantiserMethod& method) {
+	if (name == "popularity") { method = QuantiserMethod::popularity; }
+	else if (name == "median-cut") { method = QuantiserMethod::medianCut; }
+	else if (name == "octree") { method = QuantiserMethod::octree; }
+	else { return false; }
+	return true;
+}
+
+static uint32_t channel(ARGB colour, int index) { return (colour >> (16 - 8 * index)) & 0xff; }
+
+static std::vector<ARGB> sortedUnique(std::vector<ARGB> palette) {
+	std::sort(palette.begin(), palette.end());
+	palette.erase(std::unique(palette.begin(), palette.end()), palette.end());
+	return palette;
+}
+
+std::vector<ARGB> quantiseColours(const ColourHistogram& histogram, size_t maxColours, QuantiserMethod method) {
+	if (histogram.empty() || maxColours == 0) { return {}; }
+	ScratchVector<ColourHistogram::Entry> colours = histogram.entries();
+	if (colours.size() <= maxColours) {
+		std::vector<ARGB> palette;
+		palette.reserve(colours.size());
+		for (const ColourHistogram::Entry& entry : colours) { palette.push_back(entry.colour); }
+		return sortedUnique(palette);
+	}
+	switch (method) {
+	case QuantiserMethod::popularity: return quantisePopularity(std::move(colours), maxColours);
+	case QuantiserMethod::medianCut: return quantiseMedianCut(std::move(colours), maxColours);
+	case QuantiserMethod::octree: return quantiseOctree(colours, maxColours);
+	}
+	return {};
+}
+
+std::vector<ARGB> quantisePopularity(ScratchVector<ColourHistogram::Entry> colours, size_t maxColours) {
+	size_t paletteSize = std::min(maxColours, colours.size());
+	// Ties are broken by colour so the result does not depend on histogram order
+	std::partial_sort(colours.begin(), colours.begin() + paletteSize, colours.end(), [](auto& a, auto& b) { return a.count != b.count ? a.count > b.count : a.colour < b.colour; });
+	std::vector<ARGB> palette;
+	palette.reserve(paletteSize);
+	for (size_t i = 0; i < paletteSize; i++) { palette.push_back(colours[i].colour); }
+	return sortedUnique(palette);
+}
+
+namespace {
+	struct ColourBox {
+		size_t begin;
+		size_t end;
+		uint64_t population;
+		int widestChannel;
+		uint32_t range;
+	};
+
+	ColourBox measureBox(const ScratchVector<ColourHistogram::Entry>& colours, size_t begin, size_t end) {
+		uint32_t low[3] = { 255, 255, 255 };
+		uint32_t high[3] = { 0, 0, 0 };
+		uint64_t population = 0;
+		for (size_t i = begin; i < end; i++) {
+			for (int c = 0; c < 3; c++) {
+				uint32_t value = channel(colours[i].colour, c);
+				low[c] = std::min(low[c], value);
+				high[c] = std::max(high[c], value);
+			}
+			population += colours[i].count;
+		}
+		ColourBox box = { begin, end, population, 0, 0 };
+		for (int c = 0; c < 3; c++) {
+			if (high[c] - low[c] > box.range) {
+				box.range = high[c] - low[c];
+				box.widestChannel = c;
+			}
+		}
+		return box;
+	}
+}
+
+std::vector<ARGB> quantiseMedianCut(ScratchVector<ColourHistogram::Entry> colours, size_t maxColours) {
+	ScratchVector<ColourBox> boxes;
+	boxes.reserve(maxColours);
+	boxes.push_back(measureBox(colours, 0, colours.size()));
+	while (boxes.size() < maxColours) {
+		// Split the box whose pixels are most spread out
+		size_t chosen = boxes.size();
+		uint64_t bestScore = 0;
+		for (size_t i = 0; i < boxes.size(); i++) {
+			uint64_t score = boxes[i].population * boxes[i].range;
+			if (boxes[i].end - boxes[i].begin >= 2 && score > bestScore) {
+				bestScore = score;
+				chosen = i;
+			}
+		}
+		if (chosen == boxes.size()) { break; }
+
+		ColourBox box = boxes[chosen];
+		int c = box.widestChannel;
+		std::sort(colours.begin() + box.begin, colours.begin() + box.end, [c](auto& a, auto& b) { return channel(a.colour, c) < channel(b.colour, c); });
+		// Weighted median, keeping at least one colour on each side
+		size_t split = box.begin + 1;
+		uint64_t seen = colours[box.begin].count;
+		while (split < box.end - 1 && seen * 2 < box.population) {
+			seen += colours[split].count;
+			split++;
+		}
+		boxes[chosen] = measureBox(colours, box.begin, split);
+		boxes.push_back(measureBox(colours, split, box.end));
+	}
+
+	std::vector<ARGB> palette;
+	palette.reserve(boxes.size());
+	for (const ColourBox& box : boxes) {
+		uint64_t sums[3] = { 0, 0, 0 };
+		for (size_t i = box.begin; i < box.end; i++) {
+			for (int c = 0; c < 3; c++) { sums[c] += static_cast<uint64_t>(channel(colours[i].colour, c)) * colours[i].count; }
+		}
+		ARGB colour = 0xff000000;
+		for (int c = 0; c < 3; c++) {
+			colour |= static_cast<ARGB>((sums[c] + box.population / 2) / box.population) << (16 - 8 * c);
+		}
+		palette.push_back(colour);
+	}
+	return sortedUnique(palette);
+}
+
+namespace {
+	struct OctreeNode {
+		uint64_t sums[3] = { 0, 0, 0 };
+		uint64_t population = 0;
+		int32_t children[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+		bool leaf = false;
+	};
+}
+
+std::vector<ARGB> quantiseOctree(const ScratchVector<ColourHistogram::Entry>& colours, size_t maxColours) {
+	constexpr int depth = 8;
+	ScratchVector<OctreeNode> nodes(1);
+	ScratchVector<ScratchVector<int32_t>> levels(depth);	// interior nodes by level
+	levels[0].push_back(0);
+	size_t leafCount = 0;
+
+	for (const ColourHistogram::Entry& entry : colours) {
+		uint32_t red = channel(entry.colour, 0), green = channel(entry.colour, 1), blue = channel(entry.colour, 2);
+		int32_t node = 0;
+		for (int level = 0; level < depth; level++) {
+			nodes[node].population += entry.count;
+			int bit = 7 - level;
+			int child = ((red >> bit) & 1) << 2 | ((green >> bit) & 1) << 1 | ((blue >> bit) & 1);
+			if (nodes[node].children[child] < 0) {
+				nodes[node].children[child] = static_cast<int32_t>(nodes.size());
+				nodes.emplace_back();
+				if (level + 1 < depth) { levels[level + 1].push_back(nodes[node].children[child]); }
+				else {
+					nodes.back().leaf = true;
+					leafCount++;
+				}
+			}
+			node = nodes[node].children[child];
+		}
+		nodes[node].population += entry.count;
+		nodes[node].sums[0] += static_cast<uint64_t>(red) * entry.count;
+		nodes[node].sums[1] += static_cast<uint64_t>(green) * entry.count;
+		nodes[node].sums[2] += static_cast<uint64_t>(blue) * entry.count;
+	}
+
+	// Fold the deepest, least populated interior nodes into leaves until the palette fits
+	for (int level = depth - 1; level >= 0 && leafCount > maxColours; level--) {
+		ScratchVector<int32_t>& candidates = levels[level];
+		std::sort(candidates.begin(), candidates.end(), [&nodes](int32_t a, int32_t b) { return nodes[a].population != nodes[b].population ? nodes[a].population < nodes[b].population : a < b; });
+		for (int32_t index : candidates) {
+			if (leafCount <= maxColours) { break; }
+			OctreeNode& node = nodes[index];
+			size_t merged = 0;
+			for (int32_t& child : node.children) {
+				if (child < 0) { continue; }
+				for (int c = 0; c < 3; c++) { node.sums[c] += nodes[child].sums[c]; }
+				nodes[child].leaf = false;
+				child = -1;
+				merged++;
+			}
+			node.leaf = true;
+			leafCount = leafCount - merged + 1;
+		}
+	}
+
+	std::vector<ARGB> palette;
+	palette.reserve(leafCount);
+	for (const OctreeNode& node : nodes) {
+		if (!node.leaf || node.population == 0) { continue; }
+		ARGB colour = 0xff000000;
+		for (int c = 0; c < 3; c++) {
+			colour |= static_cast<ARGB>((node.sums[c] + node.population / 2) / node.population) << (16 - 8 * c);
+		}
+		palette.push_back(colour);
+	}
+	return sortedUnique(palette);
+}
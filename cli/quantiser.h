@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "colourhistogram.h"
+
+enum class QuantiserMethod {
+	popularity,	// the most frequent colours, unchanged
+	medianCut,	// recursively split the colour box with the most weighted spread at its weighted median
+	octree		// 8-level RGB octree, folding the least populated branches together
+};
+
+// Parses "popularity", "median-cut" or "octree"
+bool parseQuantiserMethod(const std::string& name, QuantiserMethod& method);
+
+// Builds a palette of at most maxColours entries from a histogram of the image's colours. Colours are weighted by
+// their counts. If the histogram already fits it is returned as is. The palette is sorted by ARGB value.
+std::vector<ARGB> quantiseColours(const ColourHistogram& histogram, size_t maxColours, QuantiserMethod method);
+
+std::vector<ARGB> quantisePopularity(ScratchVector<ColourHistogram::Entry> colours, size_t maxColours);
+std::vector<ARGB> quantiseMedianCut(ScratchVector<ColourHistogram::Entry> colours, size_t maxColours);
+std::vector<ARGB> quantiseOctree(const ScratchVector<ColourHistogram::Entry>& colours, size_t maxColours);
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <array>
+#include "rleiheader.h"
+#include "rans.h"
+
+constexpr uint32_t scaleBits = 12;
+constexpr uint32_t totalFrequency = 1 << scaleBits;
+constexpr uint32_t lowerBound = 1 << 23;	// states are kept in [lowerBound, lowerBound << 8)
+constexpr int lanes = 4;
+
+enum BlockMode : uint8_t { stored = 0, coded = 1 };
+
+// Scales symbol counts to frequencies summing to totalFrequency, keeping every symbol that occurs at 1 or more
+static void normaliseFrequencies(const uint64_t* counts, uint64_t total, uint32_t* frequencies) {
+	int64_t sum = 0;
+	for (int s = 0; s < 256; s++) {
+		frequencies[s] = counts[s] == 0 ? 0 : std::max<uint32_t>(static_cast<uint32_t>(counts[s] * totalFrequency / total), 1);
+		sum += frequencies[s];
+	}
+	// Rounding leaves the sum a little off; settle the difference on the most frequent symbols, which it hurts least
+	std::array<uint8_t, 256> order;
+	for (int s = 0; s < 256; s++) { order[s] = static_cast<uint8_t>(s); }
+	std::sort(order.begin(), order.end(), [&](uint8_t a, uint8_t b) { return frequencies[a] != frequencies[b] ? frequencies[a] > frequencies[b] : a < b; });
+	int64_t difference = static_cast<int64_t>(totalFrequency) - sum;
+	if (difference > 0) { frequencies[order[0]] += static_cast<uint32_t>(difference); }
+	while (difference < 0) {
+		for (int i = 0; i < 256 && difference < 0; i++) {
+			if (frequencies[order[i]] > 1) {
+				frequencies[order[i]]--;
+				difference++;
+			}
+		}
+	}
+}
+
+static void storeBlock(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+	out.push_back(stored);
+	out.insert(out.end(), data, data + size);
+}
+
+void ransEncode(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+	if (size == 0 || size > UINT32_MAX) {
+		storeBlock(data, size, out);
+		return;
+	}
+	uint64_t counts[256] = {};
+	for (size_t i = 0; i < size; i++) { counts[data[i]]++; }
+	uint32_t frequencies[256];
+	normaliseFrequencies(counts, size, frequencies);
+	uint32_t starts[256];
+	uint32_t start = 0;
+	for (int s = 0; s < 256; s++) {
+		starts[s] = start;
+		start += frequencies[s];
+	}
+
+	// rANS encodes back to front, so the bytes are written from the end of a buffer big enough for the worst case
+	std::vector<uint8_t> buffer(size + size / 2 + 64);
+	uint8_t* end = buffer.data() + buffer.size();
+	uint8_t* pointer = end;
+	uint32_t states[lanes];
+	for (uint32_t& state : states) { state = lowerBound; }
+	for (size_t i = size; i-- > 0;) {
+		uint32_t& state = states[i % lanes];
+		uint32_t frequency = frequencies[data[i]];
+		uint32_t limit = ((lowerBound >> scaleBits) << 8) * frequency;
+		while (state >= limit) {
+			*--pointer = static_cast<uint8_t>(state);
+			state >>= 8;
+		}
+		state = ((state / frequency) << scaleBits) + (state % frequency) + starts[data[i]];
+		if (pointer - buffer.data() < 16) {
+			storeBlock(data, size, out);
+			return;
+		}
+	}
+	for (int lane = lanes - 1; lane >= 0; lane--) {
+		pointer -= 4;
+		storeLE32(pointer, states[lane]);
+	}
+
+	size_t symbols = 0;
+	for (int s = 0; s < 256; s++) { symbols += frequencies[s] != 0; }
+	size_t codedSize = 1 + 4 + 32 + symbols * 2 + static_cast<size_t>(end - pointer);
+	if (codedSize >= size + 1) {
+		storeBlock(data, size, out);
+		return;
+	}
+	uint8_t prefix[1 + 4 + 32] = { coded };
+	storeLE32(prefix + 1, static_cast<uint32_t>(size));
+	for (int s = 0; s < 256; s++) {
+		if (frequencies[s] != 0) { prefix[5 + (s >> 3)] |= static_cast<uint8_t>(1 << (s & 7)); }
+	}
+	out.reserve(out.size() + codedSize);
+	out.insert(out.end(), prefix, prefix + sizeof(prefix));
+	for (int s = 0; s < 256; s++) {
+		if (frequencies[s] == 0) { continue; }
+		out.push_back(static_cast<uint8_t>(frequencies[s]));
+		out.push_back(static_cast<uint8_t>(frequencies[s] >> 8));
+	}
+	out.insert(out.end(), pointer, end);
+}
+
+bool ransDecode(const uint8_t* block, size_t blockSize, size_t maxSize, std::vector<uint8_t>& out) {
+	if (blockSize == 0) { return false; }
+	if (block[0] == stored) {
+		if (blockSize - 1 > maxSize) { return false; }
+		out.assign(block + 1, block + blockSize);
+		return true;
+	}
+	if (block[0] != coded || blockSize < 1 + 4 + 32) { return false; }
+	size_t size = loadLE32(block + 1);
+	if (size > maxSize) { return false; }
+	const uint8_t* bitmap = block + 5;
+	const uint8_t* pointer = block + 37;
+	const uint8_t* end = block + blockSize;
+
+	// Slot -> symbol table: each of the 2^12 slots holds its symbol's frequency - 1, its offset within the
+	// symbol's range and the symbol, packed 12:12:8 into one word
+	std::array<uint32_t, totalFrequency> slots;
+	uint32_t start = 0;
+	for (int s = 0; s < 256; s++) {
+		if (!(bitmap[s >> 3] & (1 << (s & 7)))) { continue; }
+		if (end - pointer < 2) { return false; }
+		uint32_t frequency = loadLE16(pointer);
+		pointer += 2;
+		if (frequency == 0 || start + frequency > totalFrequency) { return false; }
+		for (uint32_t i = 0; i < frequency; i++) { slots[start + i] = (frequency - 1) << 20 | i << 8 | static_cast<uint32_t>(s); }
+		start += frequency;
+	}
+	if (start != totalFrequency || end - pointer < 4 * lanes) { return false; }
+	uint32_t states[lanes];
+	for (uint32_t& state : states) {
+		state = loadLE32(pointer);
+		pointer += 4;
+	}
+
+	out.resize(size);
+	uint8_t* output = out.data();
+	// A valid state never needs more than two bytes to get back above lowerBound, so four symbols read at most
+	// eight. Until the last eight bytes no bounds checks are needed; after that, running past the end of a damaged
+	// block reads zeros, so a bad block decodes to garbage but stays in bounds.
+	auto decodeSlot = [&](uint32_t& state) {
+		uint32_t slot = slots[state & (totalFrequency - 1)];
+		state = ((slot >> 20) + 1) * (state >> scaleBits) + (slot >> 8 & 0xfff);
+		return static_cast<uint8_t>(slot);
+	};
+	// Renormalises without branching: reads the next two bytes and keeps as many as the state needs
+	auto step = [&](uint32_t& state) {
+		uint8_t symbol = decodeSlot(state);
+		uint32_t next = static_cast<uint32_t>(pointer[0]) << 8 | pointer[1];
+		uint32_t count = (state < lowerBound) + (state < (lowerBound >> 8));
+		state = state << (8 * count) | next >> (16 - 8 * count);
+		pointer += count;
+		return symbol;
+	};
+	auto checkedStep = [&](uint32_t& state) {
+		uint8_t symbol = decodeSlot(state);
+		if (state < lowerBound) {
+			state = state << 8 | (pointer < end ? *pointer++ : 0);
+			if (state < lowerBound) { state = state << 8 | (pointer < end ? *pointer++ : 0); }
+		}
+		return symbol;
+	};
+	size_t i = 0;
+	for (; i + lanes <= size && end - pointer >= 2 * lanes; i += lanes) {
+		output[i] = step(states[0]);
+		output[i + 1] = step(states[1]);
+		output[i + 2] = step(states[2]);
+		output[i + 3] = step(states[3]);
+	}
+	for (; i < size; i++) { output[i] = checkedStep(states[i % lanes]); }
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Order-0 rANS entropy coder for byte streams, with four interleaved states so the decoder has four independent
+// dependency chains to overlap. Each block carries its own frequency table, scaled to 2^12, ahead of the coded
+// bytes:
+//   uint8   mode: 0 = the bytes are stored as they are, 1 = rANS
+//   -- rANS blocks only --
+//   uint32  decoded size (little-endian)
+//   uint8   [32] bitmap of the symbols that occur
+//   uint16  frequency of each of those symbols, in symbol order (little-endian)
+//   uint32  [4] initial decoder states, then the renormalisation bytes
+// Blocks that would not get smaller are stored.
+
+// Appends the coded form of data[0, size) to 'out'
+void ransEncode(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+// Decodes a block written by ransEncode into 'out'. Returns false if the block is malformed or would decode to
+// more than maxSize bytes.
+bool ransDecode(const uint8_t* block, size_t blockSize, size_t maxSize, std::vector<uint8_t>& out);
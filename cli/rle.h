@@ -0,0 +1,137 @@
+#pragma once
+#include <stdint.h>
+#include <bit>
+#include "bitvector.h"
+#include "runcoding.h"
+
+// Streaming run-length encoder. Units are fed in one at a time as integers, straight from the pixel loops,
+// and every finished run is written to 'out' as a single packLength-bit code: the unit in the high unitLength
+// bits, followed by the run length in the remaining (packLength - unitLength) bits. Runs longer than the run
+// field can hold are split into several codes of the maximum length. With Exp-Golomb run coding the unit is
+// followed by a variable length run instead, and packLength is not used.
+class RunLengthEncoder {
+private:
+	bitvector& out;
+	uint32_t unitLength;
+	uint32_t packLength;
+	uint32_t packingSpace;
+	uint32_t maxRLEValue;
+	uint32_t unitMask;
+	RunCoding coding;
+	uint32_t run = 0;
+	uint32_t length = 0;
+
+	void emit(uint32_t value, uint32_t count) {
+		uint64_t unit = value & unitMask;
+		if (coding == RunCoding::fixedWidth) {
+			out.push_many_back((unit << packingSpace) | count, packLength);
+			return;
+		}
+		// count has bitWidth significant bits; written in 2 * bitWidth - 1 bits it gets the leading zeros for free
+		uint32_t runBits = 2 * static_cast<uint32_t>(std::bit_width(count)) - 1;
+		if (unitLength + runBits <= 64) { out.push_many_back(unit << runBits | count, unitLength + runBits); }
+		else {
+			out.push_many_back(unit, unitLength);
+			out.push_many_back(count, runBits);
+		}
+	}
+public:
+	RunLengthEncoder(bitvector& out, int unitLength, int packLength, RunCoding coding = RunCoding::fixedWidth)
+		: out(out), unitLength(unitLength), packLength(packLength), packingSpace(packLength - unitLength), coding(coding) {
+		maxRLEValue = coding == RunCoding::fixedWidth ? static_cast<uint32_t>((uint64_t(1) << packingSpace) - 1) : UINT32_MAX;
+		unitMask = static_cast<uint32_t>((uint64_t(1) << unitLength) - 1);
+	}
+	~RunLengthEncoder() { finish(); }
+	RunLengthEncoder(const RunLengthEncoder&) = delete;
+	RunLengthEncoder& operator=(const RunLengthEncoder&) = delete;
+
+	// True if the unit and pack lengths describe a format this encoder can write
+	static bool validLengths(int unitLength, int packLength) {
+		return unitLength > 0 && unitLength <= 32 && packLength > unitLength && packLength - unitLength <= 32 && packLength <= 64;
+	}
+
+	void push(uint32_t unit) {
+		if (unit == run && length < maxRLEValue) { length++; return; }
+		if (length > 0) { emit(run, length); }
+		run = unit;
+		length = 1;
+	}
+	void pushRepeated(uint32_t unit, uint64_t count) {
+		if (count == 0) { return; }
+		if (unit != run) {
+			if (length > 0) { emit(run, length); }
+			run = unit;
+			length = 0;
+		}
+		uint64_t total = length + count;
+		while (total > maxRLEValue) {
+			emit(run, maxRLEValue);
+			total -= maxRLEValue;
+		}
+		length = static_cast<uint32_t>(total);
+	}
+	// Writes out the run in progress, then appends codes that were encoded elsewhere with the same lengths
+	void pushCodes(const bitvector& codes) {
+		finish();
+		out.push_many_back(codes);
+	}
+	// Writes out the run in progress. Called automatically on destruction.
+	void finish() {
+		if (length > 0) { emit(run, length); }
+		length = 0;
+	}
+};
+
+// Encodes one band of a longer unit stream on its own, so that bands can be encoded in parallel. Its first and
+// last runs may carry on from the neighbouring bands, so they are held back as (unit, count) pairs and only the
+// runs strictly between them become codes. Appending the bands to a RunLengthEncoder in order gives exactly the
+// codes that pushing every unit through it would have.
+class RunLengthBandEncoder {
+private:
+	bitvector codes;
+	RunLengthEncoder inner;
+	uint32_t firstUnit = 0;
+	uint64_t firstCount = 0;
+	uint32_t lastUnit = 0;
+	uint64_t lastCount = 0;
+	bool firstClosed = false;
+
+	void closeRun() {
+		if (!firstClosed) {
+			firstUnit = lastUnit;
+			firstCount = lastCount;
+			firstClosed = true;
+		}
+		else { inner.pushRepeated(lastUnit, lastCount); }
+	}
+public:
+	RunLengthBandEncoder(int unitLength, int packLength, RunCoding coding = RunCoding::fixedWidth) : inner(codes, unitLength, packLength, coding) {}
+
+	void push(uint32_t unit) {
+		if (lastCount > 0 && unit == lastUnit) { lastCount++; return; }
+		if (lastCount > 0) { closeRun(); }
+		lastUnit = unit;
+		lastCount = 1;
+	}
+	void pushRepeated(uint32_t unit, uint64_t count) {
+		if (count == 0) { return; }
+		if (lastCount > 0 && unit != lastUnit) { closeRun(); lastCount = 0; }
+		lastUnit = unit;
+		lastCount += count;
+	}
+	// Call once every unit of the band has been pushed
+	void finish() {
+		inner.finish();
+		// A band holding a single run only has a first run
+		if (!firstClosed && lastCount > 0) {
+			closeRun();
+			lastCount = 0;
+		}
+	}
+	void appendTo(RunLengthEncoder& encoder) const {
+		encoder.pushRepeated(firstUnit, firstCount);
+		if (lastCount == 0) { return; }
+		encoder.pushCodes(codes);
+		encoder.pushRepeated(lastUnit, lastCount);
+	}
+};
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <iostream>
+#include "rleiheader.h"
+
+// Offset of the checksum, which covers every byte before it
+constexpr size_t checksumOffset = 36;
+
+uint32_t compressedImageHeaderChecksum(const uint8_t* bytes) {
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < checksumOffset; i++) {
+		crc ^= bytes[i];
+		for (int bit = 0; bit < 8; bit++) { crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1))); }
+	}
+	return ~crc;
+}
+
+void serialiseCompressedImageHeader(const CompressedImage& header, uint8_t* out) {
+	memcpy(out, header.identifier, 4);
+	storeLE16(out + 4, header.version);
+	storeLE16(out + 6, header.rowPrediction);
+	storeLE32(out + 8, header.imageSize);
+	storeLE16(out + 12, header.width);
+	storeLE16(out + 14, header.height);
+	storeLE32(out + 16, header.imageDataSizeBytes);
+	storeLE32(out + 20, static_cast<uint32_t>(header.colourFormat));
+	out[24] = header.unitLength;
+	out[25] = header.packedLength;
+	out[26] = header.paletteSize;
+	out[27] = static_cast<uint8_t>(header.runCoding);
+	storeLE16(out + 28, header.paletteSizeBytes);
+	storeLE16(out + 30, header.stripeHeight);
+	storeLE32(out + 32, static_cast<uint32_t>(header.paletteColourFormat));
+	storeLE32(out + checksumOffset, compressedImageHeaderChecksum(out));
+}
+
+bool parseCompressedImageHeader(const uint8_t* data, size_t size, CompressedImage& header) {
+	if (data == nullptr || size < compressedImageHeaderSize) {
+		std::cerr << "[Error] File is too small to be a compressed image" << std::endl;
+		return false;
+	}
+	if (memcmp(data, "RLEI", 4) != 0) {
+		std::cerr << "[Error] File is not a compressed image (missing RLEI identifier)" << std::endl;
+		return false;
+	}
+	uint32_t checksum = loadLE32(data + checksumOffset);
+	if (checksum != 0 && checksum != compressedImageHeaderChecksum(data)) {
+		std::cerr << "[Error] Compressed image header is corrupt (checksum mismatch)" << std::endl;
+		return false;
+	}
+	memcpy(header.identifier, data, 4);
+	header.version = loadLE16(data + 4);
+	header.rowPrediction = loadLE16(data + 6);
+	header.imageSize = loadLE32(data + 8);
+	header.width = loadLE16(data + 12);
+	header.height = loadLE16(data + 14);
+	header.imageDataSizeBytes = loadLE32(data + 16);
+	header.colourFormat = static_cast<CompressedImageColourFormat>(loadLE32(data + 20));
+	header.unitLength = data[24];
+	header.packedLength = data[25];
+	header.paletteSize = data[26];
+	header.runCoding = static_cast<RunCoding>(data[27]);
+	header.paletteSizeBytes = loadLE16(data + 28);
+	header.stripeHeight = loadLE16(data + 30);
+	header.paletteColourFormat = static_cast<CompressedImagePaletteFormat>(loadLE32(data + 32));
+	header.headerChecksum = checksum;
+	header.palette = const_cast<uint8_t*>(data) + compressedImageHeaderSize;
+	header.imageData = header.palette;
+	return true;
+}
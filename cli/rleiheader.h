@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "cli.h"
+
+// The fixed .rlei header as it is stored on disk: 40 bytes, every field little-endian, whatever the compiler's
+// struct padding, enum size or pointer width.
+//   0  char[4]  identifier "RLEI"       24  uint8   unitLength
+//   4  uint16   version                 25  uint8   packedLength
+//   6  uint16   rowPrediction           26  uint8   paletteSize
+//   8  uint32   imageSize               27  uint8   runCoding
+//  12  uint16   width                   28  uint16  paletteSizeBytes
+//  14  uint16   height                  30  uint16  stripeHeight
+//  16  uint32   imageDataSizeBytes      32  uint32  paletteColourFormat
+//  20  uint32   colourFormat            36  uint32  headerChecksum
+// This matches the raw struct older writers dumped with MSVC, so their files still read: their version was a
+// uint32, so rowPrediction reads as 0.
+constexpr size_t compressedImageHeaderSize = 40;
+
+inline uint16_t loadLE16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+inline uint32_t loadLE32(const uint8_t* p) {
+	return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+inline void storeLE16(uint8_t* p, uint16_t value) {
+	p[0] = static_cast<uint8_t>(value);
+	p[1] = static_cast<uint8_t>(value >> 8);
+}
+inline void storeLE32(uint8_t* p, uint32_t value) {
+	for (int i = 0; i < 4; i++) { p[i] = static_cast<uint8_t>(value >> (8 * i)); }
+}
+
+// CRC-32 of the first 36 header bytes. Older writers left the field 0, which is taken to mean "not checked".
+uint32_t compressedImageHeaderChecksum(const uint8_t* bytes);
+
+// Writes 'header' to 'out' (compressedImageHeaderSize bytes), filling in the checksum
+void serialiseCompressedImageHeader(const CompressedImage& header, uint8_t* out);
+
+// Decodes the header at the start of 'data' in place, e.g. straight from a mapped file. Checks the size, the
+// identifier and the checksum; palette and imageData are pointed just past the header and must be fixed up by
+// the caller. Returns false, with a message, if any check fails.
+bool parseCompressedImageHeader(const uint8_t* data, size_t size, CompressedImage& header);
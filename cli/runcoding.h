@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+// How the run length after each unit of an .rlei stream is written
+enum class RunCoding : uint8_t {
+	// A packedLength - unitLength bit field; longer runs are split into several codes
+	fixedWidth = 0,
+	// Order-0 Exp-Golomb: for a run of n, floor(log2 n) zero bits and then n in binary. A run of 1 takes one
+	// bit and every run fits in a single code.
+	expGolomb = 1
+};
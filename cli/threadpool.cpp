@@ -0,0 +1,89 @@
+#include "threadpool.h"
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+	if (threads == 0) { threads = std::thread::hardware_concurrency(); }
+	if (threads == 0) { threads = 1; }
+	for (size_t i = 0; i < threads; i++) { queues.push_back(std::make_unique<TaskQueue>()); }
+	for (size_t i = 0; i < threads; i++) { workers.emplace_back(&WorkStealingPool::workerLoop, this, i); }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) { worker.join(); }
+}
+
+bool WorkStealingPool::takeTask(size_t home, std::function<void()>& task) {
+	size_t count = queues.size();
+	for (size_t i = 0; i < count; i++) {
+		size_t index = (home + i) % count;
+		TaskQueue& queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) { continue; }
+		if (i == 0 && home < count) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		std::lock_guard<std::mutex> wakeLock(wakeMutex);
+		queued--;
+		return true;
+	}
+	return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+	std::function<void()> task;
+	while (true) {
+		if (takeTask(index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wake.wait(lock, [this] { return stopping || queued > 0; });
+		if (stopping && queued == 0) { return; }
+	}
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+	size_t index = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+void WorkStealingPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+	if (count == 0) { return; }
+	std::atomic<size_t> remaining{ count };
+	std::mutex doneMutex;
+	std::condition_variable done;
+	for (size_t i = 0; i < count; i++) {
+		submit([&, i] {
+			body(i);
+			// Decrement under the lock so the caller cannot return, destroying these locals, before notify_all is done
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (remaining.fetch_sub(1) == 1) { done.notify_all(); }
+		});
+	}
+	// Help out, stealing from every queue, until nothing is left to take
+	std::function<void()> task;
+	while (remaining.load() > 0 && takeTask(queues.size(), task)) {
+		task();
+		task = nullptr;
+	}
+	std::unique_lock<std::mutex> lock(doneMutex);
+	done.wait(lock, [&remaining] { return remaining.load() == 0; });
+}
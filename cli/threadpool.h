@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. Workers take tasks from the back of their own deque
+// and, once it is empty, steal from the front of the others', so uneven tasks still keep every thread busy.
+class WorkStealingPool {
+private:
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	size_t queued = 0;	// tasks submitted but not yet taken, guarded by wakeMutex
+	bool stopping = false;
+	std::atomic<size_t> nextQueue{ 0 };
+
+	// Takes a task from queue 'home' (its back), or failing that from any other queue (their front)
+	bool takeTask(size_t home, std::function<void()>& task);
+	void workerLoop(size_t index);
+public:
+	// 0 threads means one per hardware thread
+	explicit WorkStealingPool(size_t threads = 0);
+	~WorkStealingPool();
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	size_t size() const { return workers.size(); }
+	void submit(std::function<void()> task);
+	// Runs body(0) to body(count - 1) on the pool and returns once all of them have finished.
+	// The calling thread runs tasks too while it waits.
+	void parallelFor(size_t count, const std::function<void(size_t)>& body);
+};
@@ -0,0 +1,87 @@
+// colourKernelBench.cpp : Times the 555/565 row kernels on each instruction set against the scalar path.
+// Usage: colourKernelBench [bitmap] [passes] - defaults to Tests/large/slugcat.bmp and 2000 passes.
+//
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "bmp.h"
+#include "mappedfile.h"
+#include "colourkernels.h"
+
+struct BenchCase {
+	const char* name;
+	bool needs24bpp;
+	void (*run)(const BMPView& view, const Image& image, uint32_t y, uint16_t* out);
+};
+
+// FNV-1a over every unit of every row, so a kernel that differs anywhere in the output is caught
+static uint64_t outputChecksum(const BenchCase& bench, const BMPView& view, const Image& image, std::vector<uint16_t>& out) {
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t y = 0; y < view.height; y++) {
+		bench.run(view, image, y, out.data());
+		for (uint16_t unit : out) { hash = (hash ^ unit) * 1099511628211ull; }
+	}
+	return hash;
+}
+
+int main(int argc, char** argv)
+{
+	std::string path = argc > 1 ? argv[1] : "../Tests/large/slugcat.bmp";
+	int passes = argc > 2 ? std::stoi(argv[2]) : 2000;
+
+	MappedFile file;
+	BMPView view;
+	if (!file.open(path) || !view.open(file.data(), file.size())) {
+		std::cerr << "[Error] Could not open " << path << std::endl;
+		return 1;
+	}
+	Image image;
+	view.decode(image);
+	bool raw24 = view.header().bitsPerPixel == 24;
+	std::cout << "[Info] " << path << ": " << view.width << "x" << view.height << ", " << view.header().bitsPerPixel << "bpp, " << passes << " passes" << std::endl;
+
+	BenchCase cases[] = {
+		{ "565 from ARGB rows", false, [](const BMPView&, const Image& image, uint32_t y, uint16_t* out) { rowToColour565(image.row(y), image.width, out); } },
+		{ "555 from ARGB rows", false, [](const BMPView&, const Image& image, uint32_t y, uint16_t* out) { rowToColour555(image.row(y), image.width, out); } },
+		{ "565 from 24bpp rows", true, [](const BMPView& view, const Image&, uint32_t y, uint16_t* out) { rowBGRToColour565(view.rawRow(y), view.width, out); } },
+		{ "555 from 24bpp rows", true, [](const BMPView& view, const Image&, uint32_t y, uint16_t* out) { rowBGRToColour555(view.rawRow(y), view.width, out); } },
+	};
+
+	std::vector<uint16_t> out(view.width);
+	double pixels = static_cast<double>(view.width) * view.height * passes;
+	int failures = 0;
+	for (const BenchCase& bench : cases) {
+		if (bench.needs24bpp && !raw24) { continue; }
+		double scalarSeconds = 0;
+		uint64_t scalarChecksum = 0;
+		for (KernelISA isa : { KernelISA::scalar, KernelISA::sse41, KernelISA::avx2 }) {
+			if (!setKernelISA(isa)) { continue; }
+			// Reading one unit per row keeps the timed passes from being optimised away
+			uint64_t sink = 0;
+			auto start = std::chrono::steady_clock::now();
+			for (int pass = 0; pass < passes; pass++) {
+				for (uint32_t y = 0; y < view.height; y++) {
+					bench.run(view, image, y, out.data());
+					sink += out[y % view.width];
+				}
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			volatile uint64_t keep = sink;
+			(void)keep;
+			uint64_t checksum = outputChecksum(bench, view, image, out);
+			if (isa == KernelISA::scalar) {
+				scalarSeconds = seconds;
+				scalarChecksum = checksum;
+			}
+			else if (checksum != scalarChecksum) {
+				std::cerr << "[Error] " << bench.name << ": " << kernelISAName(isa) << " output differs from scalar" << std::endl;
+				failures++;
+			}
+			std::cout << "[Info] " << bench.name << ", " << kernelISAName(isa) << ": " << seconds * 1000 << "ms, " << pixels / seconds / 1e6 << " Mpx/s, " << scalarSeconds / seconds << "x scalar" << std::endl;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+// colourKernelTest.cpp : Checks the integer row kernels in colourkernels.cpp against ConvertibleColour for every 24-bit colour,
+// on every instruction set the CPU supports.
+//
+
+#include <iostream>
+#include <stdint.h>
+#include "colorconverter.h"
+#include "colourkernels.h"
+
+enum class KernelInput { argb, bgr };
+
+struct KernelCheck {
+	const char* name;
+	KernelInput input;
+	uint32_t (*reference)(ARGB colour);
+	uint32_t mismatches = 0;
+	ARGB firstMismatch = 0;
+};
+
+static void runKernel(size_t index, const ARGB* row, const uint8_t* bgrRow, uint32_t width, uint16_t* units16, uint8_t* units8) {
+	switch (index) {
+	case 0: rowToColour555(row, width, units16); break;
+	case 1: rowToColour565(row, width, units16); break;
+	case 2: rowBGRToColour555(bgrRow, width, units16); break;
+	case 3: rowBGRToColour565(bgrRow, width, units16); break;
+	case 4: rowToColour3Bit(row, width, units8); break;
+	case 5: rowToColour6Bit(row, width, units8); break;
+	default: rowToGreyscale(row, width, static_cast<int>(index) - 5, units8); break;
+	}
+}
+
+static int checkAllColours() {
+	KernelCheck checks[] = {
+		{ "colour555", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toColour555(); } },
+		{ "colour565", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toColour565(); } },
+		{ "colour555 (24bpp)", KernelInput::bgr, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toColour555(); } },
+		{ "colour565 (24bpp)", KernelInput::bgr, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toColour565(); } },
+		{ "colour3Bit", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toColour3Bit(); } },
+		{ "colour6Bit", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toColour6Bit(); } },
+		{ "greyscale1Bit", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toGreyscale1Bit(); } },
+		{ "greyscale2Bit", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toGreyscale2Bit(); } },
+		{ "greyscale3Bit", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toGreyscale3Bit(); } },
+		{ "greyscale4Bit", KernelInput::argb, [](ARGB c) -> uint32_t { return ConvertibleColour().fromColourARGB(c)->toGreyscale4Bit(); } },
+	};
+	constexpr size_t checkCount = sizeof(checks) / sizeof(checks[0]);
+
+	// One row per red/green pair, covering every blue value. The width leaves a tail for the SIMD kernels.
+	constexpr uint32_t width = 256;
+	ARGB row[width];
+	uint8_t bgrRow[width * 3];
+	uint16_t units16[width];
+	uint8_t units8[width];
+	for (uint32_t red = 0; red < 256; red++) {
+		for (uint32_t green = 0; green < 256; green++) {
+			for (uint32_t blue = 0; blue < 256; blue++) {
+				row[blue] = 0xff000000 | red << 16 | green << 8 | blue;
+				bgrRow[blue * 3] = static_cast<uint8_t>(blue);
+				bgrRow[blue * 3 + 1] = static_cast<uint8_t>(green);
+				bgrRow[blue * 3 + 2] = static_cast<uint8_t>(red);
+			}
+			for (size_t i = 0; i < checkCount; i++) {
+				bool wide = i < 4;
+				runKernel(i, row, bgrRow, width, units16, units8);
+				for (uint32_t x = 0; x < width; x++) {
+					uint32_t actual = wide ? units16[x] : units8[x];
+					if (actual != checks[i].reference(row[x])) {
+						if (checks[i].mismatches++ == 0) { checks[i].firstMismatch = row[x]; }
+					}
+				}
+			}
+		}
+	}
+
+	int failures = 0;
+	for (const KernelCheck& check : checks) {
+		if (check.mismatches == 0) {
+			std::cout << "[Info] " << kernelISAName(kernelISA()) << " " << check.name << ": all 16777216 colours match" << std::endl;
+			continue;
+		}
+		std::cerr << "[Error] " << kernelISAName(kernelISA()) << " " << check.name << ": " << check.mismatches << " mismatches, first at 0x" << std::hex << check.firstMismatch << std::dec << std::endl;
+		failures++;
+	}
+	return failures;
+}
+
+int main()
+{
+	int failures = 0;
+	for (KernelISA isa : { KernelISA::scalar, KernelISA::sse41, KernelISA::avx2 }) {
+		if (!setKernelISA(isa)) {
+			std::cout << "[Info] " << kernelISAName(isa) << " not supported by this CPU, skipping" << std::endl;
+			continue;
+		}
+		failures += checkAllColours();
+	}
+	return failures == 0 ? 0 : 1;
+}
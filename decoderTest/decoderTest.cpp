@@ -0,0 +1,242 @@
+// decoderTest.cpp : Checks the partial decoders in decoder.cpp against decodeRLEI: decodeRLEIRows over row ranges
+// that start, end and cross stripe boundaries, and RLEIRowDecoder / decodeRLEIRowByRow row by row, for version 1,
+// 2 and 3 files, with and without row prediction, in both run codings, intact and damaged.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "bitvector.h"
+#include "rle.h"
+#include "rans.h"
+#include "prediction.h"
+#include "rleiheader.h"
+#include "decoder.h"
+
+struct Format {
+	const char* name;
+	CompressedImageColourFormat colourFormat;
+	uint8_t unitLength;
+	uint8_t packedLength;
+	RunCoding runCoding;
+};
+
+struct Layout {
+	const char* name;
+	uint16_t version;
+	uint16_t stripeHeight;	// 0 for version 1
+	bool predicted;
+};
+
+// Units in runs of random length, some of them longer than a row
+static std::vector<uint32_t> makeUnits(std::mt19937& random, uint32_t width, uint32_t height, int unitLength) {
+	std::vector<uint32_t> units;
+	size_t count = static_cast<size_t>(width) * height;
+	uint32_t unitMask = static_cast<uint32_t>((uint64_t(1) << unitLength) - 1);
+	while (units.size() < count) {
+		uint32_t unit = random() & unitMask;
+		uint32_t run = random() % 8 == 0 ? random() % (width * 2) + 1 : random() % 4 + 1;
+		for (uint32_t i = 0; i < run && units.size() < count; i++) { units.push_back(unit); }
+	}
+	return units;
+}
+
+// Writes the units as an .rlei file the way the CLI lays one out. Predicted stripes take the predictors in turn.
+static std::vector<uint8_t> encodeFile(const std::vector<uint32_t>& units, uint32_t width, uint32_t height, const Format& format, const Layout& layout) {
+	uint32_t stripeRows = layout.version == 1 ? std::max<uint32_t>(height, 1) : layout.stripeHeight;
+	uint32_t stripes = std::max<uint32_t>((height + stripeRows - 1) / stripeRows, 1);
+	UnitChannels channels = unitChannels(format.colourFormat, format.unitLength);
+	std::vector<uint8_t> table, streams;
+	std::vector<uint32_t> residuals(width);
+	for (uint32_t stripe = 0; stripe < stripes; stripe++) {
+		bitvector stream;
+		uint32_t firstRow = stripe * stripeRows;
+		uint32_t endRow = std::min(firstRow + stripeRows, height);
+		RowPredictor predictor = static_cast<RowPredictor>(stripe % rowPredictorCount);
+		if (layout.predicted) { stream.push_many_back(static_cast<uint8_t>(predictor), 8); }
+		{
+			RunLengthEncoder encoder(stream, format.unitLength, format.packedLength, format.runCoding);
+			for (uint32_t y = firstRow; y < endRow; y++) {
+				const uint32_t* row = units.data() + static_cast<size_t>(y) * width;
+				if (!layout.predicted) {
+					for (uint32_t x = 0; x < width; x++) { encoder.push(row[x]); }
+					continue;
+				}
+				predictRow(predictor, channels, y == firstRow ? nullptr : row - width, row, residuals.data(), width);
+				for (uint32_t x = 0; x < width; x++) { encoder.push(residuals[x]); }
+			}
+		}
+		std::span<const uint8_t> bytes = stream.dump();
+		uint8_t offset[4];
+		storeLE32(offset, static_cast<uint32_t>(streams.size()));
+		table.insert(table.end(), offset, offset + 4);
+		if (layout.version == 3) { ransEncode(bytes.data(), bytes.size(), streams); }
+		else { streams.insert(streams.end(), bytes.begin(), bytes.end()); }
+	}
+	uint8_t offset[4];
+	storeLE32(offset, static_cast<uint32_t>(streams.size()));
+	table.insert(table.end(), offset, offset + 4);
+	if (layout.version == 1) { table.clear(); }
+
+	CompressedImage header{};
+	header.identifier[0] = 'R';
+	header.identifier[1] = 'L';
+	header.identifier[2] = 'E';
+	header.identifier[3] = 'I';
+	header.version = layout.version;
+	header.rowPrediction = layout.predicted ? 1 : 0;
+	header.width = static_cast<uint16_t>(width);
+	header.height = static_cast<uint16_t>(height);
+	header.imageDataSizeBytes = static_cast<uint32_t>(table.size() + streams.size());
+	header.imageSize = static_cast<uint32_t>(compressedImageHeaderSize + header.imageDataSizeBytes);
+	header.colourFormat = format.colourFormat;
+	header.unitLength = format.unitLength;
+	header.packedLength = format.packedLength;
+	header.runCoding = format.runCoding;
+	header.stripeHeight = layout.stripeHeight;
+	header.paletteColourFormat = CompressedImagePaletteFormat::noPalette;
+	std::vector<uint8_t> file(compressedImageHeaderSize);
+	serialiseCompressedImageHeader(header, file.data());
+	file.insert(file.end(), table.begin(), table.end());
+	file.insert(file.end(), streams.begin(), streams.end());
+	return file;
+}
+
+// Compares every way of decoding 'file' with decodeRLEI, adding what differs to 'failures'
+static void checkDecoders(const std::vector<uint8_t>& file, std::vector<std::string>& failures) {
+	// A file whose header or stripe table is damaged must be turned away by every decoder
+	CompressedImage header;
+	if (!readCompressedImageHeader(file.data(), file.size(), header)) {
+		RLEIRowDecoder decoder;
+		if (decoder.open(file.data(), file.size())) { failures.push_back("RLEIRowDecoder opened a file with a bad header"); }
+		if (decodeRLEIRowByRow(file.data(), file.size(), [](uint32_t, const ARGB*) { return true; })) { failures.push_back("decodeRLEIRowByRow accepted a bad header"); }
+		DecodedImage rows;
+		if (decodeRLEIRows(file.data(), file.size(), 0, 0, rows)) { failures.push_back("decodeRLEIRows accepted a bad header"); }
+		return;
+	}
+	DecodedImage reference;
+	bool referenceOk = decodeRLEI(file.data(), file.size(), reference);
+	uint32_t width = reference.width;
+	uint32_t height = reference.height;
+	auto sameRows = [&](const ARGB* rows, uint32_t firstRow, uint32_t rowCount) {
+		return std::equal(rows, rows + static_cast<size_t>(rowCount) * width, reference.pixels.begin() + static_cast<size_t>(firstRow) * width);
+	};
+
+	// Pull decoder, one row at a time
+	RLEIRowDecoder decoder;
+	if (!decoder.open(file.data(), file.size())) { failures.push_back("RLEIRowDecoder::open failed"); }
+	else {
+		std::vector<ARGB> row(width);
+		uint32_t rows = 0;
+		for (; decoder.readRow(row.data()); rows++) {
+			if (!sameRows(row.data(), rows, 1)) {
+				failures.push_back("RLEIRowDecoder row " + std::to_string(rows) + " differs");
+				break;
+			}
+		}
+		if (rows < height && failures.empty()) { failures.push_back("RLEIRowDecoder stopped after " + std::to_string(rows) + " rows"); }
+		if ((decoder.damaged() == 0) != referenceOk) { failures.push_back("RLEIRowDecoder damage does not match decodeRLEI"); }
+	}
+
+	// Callback wrapper, rows in order
+	uint32_t nextRow = 0;
+	bool callbackOk = decodeRLEIRowByRow(file.data(), file.size(), [&](uint32_t y, const ARGB* row) {
+		if (y != nextRow++ || !sameRows(row, y, 1)) {
+			failures.push_back("decodeRLEIRowByRow row " + std::to_string(y) + " differs");
+			return false;
+		}
+		return true;
+	});
+	if (callbackOk != referenceOk) { failures.push_back("decodeRLEIRowByRow result does not match decodeRLEI"); }
+	if (nextRow != height) { failures.push_back("decodeRLEIRowByRow handed over " + std::to_string(nextRow) + " rows"); }
+
+	// Row ranges: the whole image, the first and last rows, and ranges ending at, starting at and spanning every
+	// stripe boundary
+	uint32_t rowsPerStripe = stripeRows(header);
+	std::vector<std::pair<uint32_t, uint32_t>> ranges = { { 0, height }, { 0, 1 }, { height - 1, 1 }, { height / 2, 0 } };
+	for (uint32_t boundary = rowsPerStripe; boundary < height; boundary += rowsPerStripe) {
+		ranges.push_back({ boundary - 1, 2 });
+		ranges.push_back({ boundary, std::min(rowsPerStripe, height - boundary) });
+		ranges.push_back({ boundary - 1, std::min(rowsPerStripe * 2 + 1, height - boundary + 1) });
+	}
+	for (auto [firstRow, rowCount] : ranges) {
+		DecodedImage rows;
+		bool rowsOk = decodeRLEIRows(file.data(), file.size(), firstRow, rowCount, rows);
+		std::string range = "decodeRLEIRows(" + std::to_string(firstRow) + ", " + std::to_string(rowCount) + ")";
+		if (rows.width != width || rows.height != rowCount || rows.pixels.size() != static_cast<size_t>(width) * rowCount) { failures.push_back(range + " has the wrong size"); }
+		else if (!sameRows(rows.pixels.data(), firstRow, rowCount)) { failures.push_back(range + " differs"); }
+		else if (referenceOk && !rowsOk) { failures.push_back(range + " failed on an intact file"); }
+	}
+	DecodedImage outside;
+	if (decodeRLEIRows(file.data(), file.size(), height, 1, outside)) { failures.push_back("decodeRLEIRows accepted a row past the end"); }
+}
+
+// Keeps the decoders' own messages about damaged files out of the test's output while it is in scope
+struct QuietErrors {
+	std::ostringstream sink;
+	std::streambuf* previous = std::cerr.rdbuf(sink.rdbuf());
+	~QuietErrors() { std::cerr.rdbuf(previous); }
+};
+
+// Returns 1, reporting the first mismatch, if any decoder differs from decodeRLEI on 'file'
+static int checkFile(const std::vector<uint8_t>& file, const std::string& name) {
+	std::vector<std::string> failures;
+	{
+		QuietErrors quiet;
+		checkDecoders(file, failures);
+	}
+	if (failures.empty()) { return 0; }
+	std::cerr << "[Error] " << name << ": " << failures.front() << (failures.size() > 1 ? " (and " + std::to_string(failures.size() - 1) + " more)" : "") << std::endl;
+	return 1;
+}
+
+int main()
+{
+	const Format formats[] = {
+		{ "pg2", CompressedImageColourFormat::packedGreyscale2Bit, 2, 8, RunCoding::fixedWidth },
+		{ "pc6", CompressedImageColourFormat::packedColour6Bit, 6, 8, RunCoding::fixedWidth },
+		{ "i8r1", CompressedImageColourFormat::index8Bit, 8, 16, RunCoding::fixedWidth },
+		{ "c565r1", CompressedImageColourFormat::colour565, 16, 24, RunCoding::fixedWidth },
+		{ "c24r1", CompressedImageColourFormat::colourFull, 24, 32, RunCoding::fixedWidth },
+		{ "pg2e", CompressedImageColourFormat::packedGreyscale2Bit, 2, 3, RunCoding::expGolomb },
+		{ "c24e", CompressedImageColourFormat::colourFull, 24, 25, RunCoding::expGolomb },
+	};
+	const Layout layouts[] = {
+		{ "v1", 1, 0, false },
+		{ "v2, 7-row stripes", 2, 7, false },
+		{ "v2, 1-row stripes", 2, 1, false },
+		{ "v3, 16-row stripes", 3, 16, false },
+		{ "v2 predicted, 5-row stripes", 2, 5, true },
+		{ "v3 predicted, 16-row stripes", 3, 16, true },
+	};
+	std::mt19937 random(25);
+	int failures = 0;
+	int checks = 0;
+	for (const Format& format : formats) {
+		for (const Layout& layout : layouts) {
+			for (auto [width, height] : { std::pair<uint32_t, uint32_t>{ 1, 1 }, { 37, 50 }, { 300, 33 } }) {
+				std::vector<uint32_t> units = makeUnits(random, width, height, format.unitLength);
+				std::vector<uint8_t> file = encodeFile(units, width, height, format, layout);
+				std::string name = std::string(format.name) + ", " + layout.name + ", " + std::to_string(width) + "x" + std::to_string(height);
+				failures += checkFile(file, name);
+				checks++;
+
+				// Flip a byte in the middle of the image data, and zero the end of the last stripe
+				std::vector<uint8_t> damaged = file;
+				damaged[compressedImageHeaderSize + (file.size() - compressedImageHeaderSize) / 2] ^= 0x5a;
+				failures += checkFile(damaged, name + ", damaged");
+				std::vector<uint8_t> zeroed = file;
+				std::fill(zeroed.end() - std::min<size_t>(4, file.size() - compressedImageHeaderSize), zeroed.end(), 0);
+				failures += checkFile(zeroed, name + ", zeroed tail");
+				checks += 2;
+			}
+		}
+	}
+	if (failures == 0) { std::cout << "[Info] All " << checks << " files decode the same through every decoder" << std::endl; }
+	else { std::cerr << "[Error] " << failures << " of " << checks << " files decode differently" << std::endl; }
+	return failures == 0 ? 0 : 1;
+}
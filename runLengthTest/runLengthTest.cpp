@@ -0,0 +1,119 @@
+// runLengthTest.cpp : Checks that bands encoded separately with RunLengthBandEncoder and appended in order give
+// exactly the codes of one serial RunLengthEncoder, for runs that cross band boundaries, bands of a single row,
+// bands shorter than the run they sit in and runs longer than a fixed-width code can hold.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include "bitvector.h"
+#include "rle.h"
+
+struct Format {
+	const char* name;
+	int unitLength;
+	int packLength;
+	RunCoding coding;
+};
+
+// Units in runs of random length. Short runs are common, with the odd run long enough to overflow the run field
+// and cover several rows.
+static std::vector<uint32_t> makeUnits(std::mt19937& random, size_t count, int unitLength, uint32_t maxRun) {
+	std::vector<uint32_t> units;
+	uint32_t unitMask = static_cast<uint32_t>((uint64_t(1) << unitLength) - 1);
+	while (units.size() < count) {
+		uint32_t unit = random() & unitMask;
+		uint32_t run = random() % 8 == 0 ? random() % maxRun + 1 : random() % 4 + 1;
+		for (uint32_t i = 0; i < run && units.size() < count; i++) { units.push_back(unit); }
+	}
+	return units;
+}
+
+static bool sameCodes(bitvector& expected, bitvector& actual) {
+	if (expected.size() != actual.size()) { return false; }
+	std::span<const uint8_t> a = expected.dump(), b = actual.dump();
+	return std::equal(a.begin(), a.end(), b.begin());
+}
+
+// Encodes 'units' serially and as bands cut at 'cuts' (the first unit of each band after the first), pushing units
+// one at a time or, with 'repeated', a run at a time as the pixel loops for long runs do
+static bool checkBands(const Format& format, const std::vector<uint32_t>& units, const std::vector<size_t>& cuts, bool repeated) {
+	bitvector serial;
+	{
+		RunLengthEncoder encoder(serial, format.unitLength, format.packLength, format.coding);
+		for (uint32_t unit : units) { encoder.push(unit); }
+	}
+
+	std::vector<size_t> starts = { 0 };
+	starts.insert(starts.end(), cuts.begin(), cuts.end());
+	starts.push_back(units.size());
+	std::vector<std::unique_ptr<RunLengthBandEncoder>> bands;
+	for (size_t band = 0; band + 1 < starts.size(); band++) {
+		bands.push_back(std::make_unique<RunLengthBandEncoder>(format.unitLength, format.packLength, format.coding));
+		RunLengthBandEncoder& encoder = *bands.back();
+		for (size_t i = starts[band]; i < starts[band + 1];) {
+			size_t end = i + 1;
+			if (repeated) {
+				while (end < starts[band + 1] && units[end] == units[i]) { end++; }
+				encoder.pushRepeated(units[i], end - i);
+			}
+			else { encoder.push(units[i]); }
+			i = end;
+		}
+		encoder.finish();
+	}
+	bitvector stitched;
+	{
+		RunLengthEncoder encoder(stitched, format.unitLength, format.packLength, format.coding);
+		for (const auto& band : bands) { band->appendTo(encoder); }
+	}
+	return sameCodes(serial, stitched);
+}
+
+int main()
+{
+	const Format formats[] = {
+		{ "pg1 (1-bit units, 7-bit runs)", 1, 8, RunCoding::fixedWidth },
+		{ "pi4 (4-bit units, 4-bit runs)", 4, 8, RunCoding::fixedWidth },
+		{ "i8r1 (8-bit units, 8-bit runs)", 8, 16, RunCoding::fixedWidth },
+		{ "c24r1 (24-bit units, 8-bit runs)", 24, 32, RunCoding::fixedWidth },
+		{ "pg2e (2-bit units, Exp-Golomb runs)", 2, 3, RunCoding::expGolomb },
+		{ "c24e (24-bit units, Exp-Golomb runs)", 24, 25, RunCoding::expGolomb },
+	};
+	std::mt19937 random(2024);
+	int failures = 0;
+	for (const Format& format : formats) {
+		uint32_t mismatches = 0;
+		uint32_t trials = 0;
+		for (uint32_t width : { 1u, 7u, 64u, 300u }) {
+			for (int trial = 0; trial < 40; trial++) {
+				uint32_t height = random() % 40 + 1;
+				// Some images are a single run, so every band sits inside it
+				uint32_t maxRun = trial % 10 == 0 ? width * height : width * 3;
+				std::vector<uint32_t> units = makeUnits(random, static_cast<size_t>(width) * height, format.unitLength, maxRun);
+
+				// Bands are whole rows, as encodePixels cuts them: single rows, a few rows, or random row counts
+				std::vector<size_t> cuts;
+				for (uint32_t row = 1; row < height; row++) {
+					bool cut = trial % 3 == 0 || random() % 3 == 0;
+					if (cut) { cuts.push_back(static_cast<size_t>(row) * width); }
+				}
+				for (bool repeated : { false, true }) {
+					trials++;
+					if (!checkBands(format, units, cuts, repeated)) {
+						if (mismatches++ == 0) { std::cerr << "[Error] " << format.name << ": " << width << "x" << height << " image in " << cuts.size() + 1 << " bands differs from the serial codes" << std::endl; }
+					}
+				}
+			}
+		}
+		if (mismatches == 0) { std::cout << "[Info] " << format.name << ": all " << trials << " banded encodes match" << std::endl; }
+		else {
+			std::cerr << "[Error] " << format.name << ": " << mismatches << " of " << trials << " banded encodes differ" << std::endl;
+			failures++;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}